@@ -1,6 +1,7 @@
 #ifndef __ROTARY_ENCODER_H__
 #define __ROTARY_ENCODER_H__
 
+#include "trace.h"
 #include "usb.h"
 #include <errno.h>
 
@@ -141,6 +142,7 @@ public:
 
     if (_callback != nullptr)
       _callback(*this);
+    TRACE(TRACE_PARAM, _id, 0, _absolute_value);
 
     return 0;
   }
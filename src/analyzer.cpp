@@ -0,0 +1,238 @@
+#include "analyzer.h"
+
+#include <algorithm>
+#include <arm_math.h>
+#include <math.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+
+#include "audio.h"
+#include "usb.h"
+
+#if ANALYZER_ENABLED
+// The analysis and the render loop both compute in float: without FPU
+// sharing, a context switch does not save the FP registers and each thread
+// corrupts the other's
+#if defined(CONFIG_FPU) && !defined(CONFIG_FPU_SHARING)
+#error "The analyzer thread needs CONFIG_FPU_SHARING"
+#endif
+
+// Below the main thread: the analysis runs while the audio loop sleeps and
+// is preempted as soon as the next block is due
+#define ANALYZER_STACK_SIZE 2048
+#define ANALYZER_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+K_THREAD_STACK_DEFINE(analyzer_stack, ANALYZER_STACK_SIZE);
+static struct k_thread analyzer_thread;
+K_SEM_DEFINE(analyzer_ready, 0, 1);
+
+// Set from the capture until the analysis is printed
+static atomic_t analyzer_busy = ATOMIC_INIT(0);
+static uint32_t analyzer_blocks = 0;
+
+static int16_t capture[SAMPLES_PER_BLOCK];
+// Windowed input, then spectrum, then bin powers: the FFT runs in place
+static float frame[ANALYZER_FFT_SIZE];
+static arm_cfft_instance_f32 cfft; // half length complex FFT
+
+/// @brief Width of a bin in Hz
+static const float BIN_HZ = (float)SAMPLE_FREQUENCY / ANALYZER_FFT_SIZE;
+
+/// @brief Bins on each side of a partial that hold its power, the main lobe
+/// of the Hann window
+static const int LOBE_BINS = 2;
+
+/// @brief Power of a full scale sine in its bin, 0 dBFS
+static const float FULL_SCALE_POWER = (32768.f * ANALYZER_FFT_SIZE / 4) *
+                                      (32768.f * ANALYZER_FFT_SIZE / 4);
+
+/// @brief Power of a partial, summed over the main lobe around it
+/// @param power the bin powers, DC excluded
+/// @param freq the partial frequency in Hz
+static float partial_power(const float *power, float freq) {
+  int bin = (int)(freq / BIN_HZ + 0.5f);
+  float sum = 0.f;
+  for (int b = std::max(bin - LOBE_BINS, 1);
+       b <= std::min(bin + LOBE_BINS, ANALYZER_FFT_SIZE / 2 - 1); b++) {
+    sum += power[b];
+  }
+  return sum;
+}
+
+/// @brief Spectrum of a real frame, in place
+/// The complex FFT of half the length runs on the frame read as complex
+/// samples (even samples real, odd ones imaginary), then each pair of bins
+/// k and N/2 - k is split into the two bins of the real input. The DC and
+/// Nyquist bins are left out, the first pair holds neither
+/// @param x the frame, ANALYZER_FFT_SIZE samples, then bins 1 to N/2 - 1 as
+/// interleaved real and imaginary parts
+static void real_fft(float *x) {
+  const int half = ANALYZER_FFT_SIZE / 2;
+  arm_cfft_f32(&cfft, x, 0, 1);
+
+  for (int k = 1; k <= half / 2; k++) {
+    int m = half - k;
+    float zr = x[2 * k];
+    float zi = x[2 * k + 1];
+    float cr = x[2 * m];
+    float ci = -x[2 * m + 1];
+
+    // Even part (Z[k] + conj Z[m]) / 2 and odd part (Z[k] - conj Z[m]) / 2j,
+    // the odd part turned by the twiddle e^(-2 pi j k / N)
+    float er = 0.5f * (zr + cr);
+    float ei = 0.5f * (zi + ci);
+    float odd_r = 0.5f * (zi - ci);
+    float odd_i = -0.5f * (zr - cr);
+    float angle = 2.f * (float)M_PI * k / ANALYZER_FFT_SIZE;
+    float wr = cosf(angle);
+    float wi = -sinf(angle);
+    float tr = wr * odd_r - wi * odd_i;
+    float ti = wr * odd_i + wi * odd_r;
+
+    // X[m] is the conjugate of E - T, written first as m == k at N/4
+    x[2 * m] = er - tr;
+    x[2 * m + 1] = ti - ei;
+    x[2 * k] = er + tr;
+    x[2 * k + 1] = ei + ti;
+  }
+}
+
+/// @brief Level in dB of a power ratio, floored at -140 dB
+static int power_db(float ratio) {
+  return ratio > 1e-14f ? (int)lroundf(10.f * log10f(ratio)) : -140;
+}
+
+static void analyze() {
+  uint32_t start = k_cycle_get_32();
+
+  int peak = 0;
+  uint32_t clips = 0;
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+    int level = abs(capture[i]);
+    peak = std::max(peak, level);
+    // The render loop clamps to +/-0x7fff
+    if (level >= 0x7fff) {
+      clips++;
+    }
+  }
+
+  if (peak == 0) {
+    printuln("[Analyzer] silent");
+    return;
+  }
+
+  // Hann window, so that the leakage of a partial stays in its main lobe
+  for (int i = 0; i < ANALYZER_FFT_SIZE; i++) {
+    float window =
+        0.5f - 0.5f * cosf(2.f * (float)M_PI * i / ANALYZER_FFT_SIZE);
+    frame[i] = capture[i] * window;
+  }
+  real_fft(frame);
+
+  // In place too: the power of bin b only overwrites bins under b. The DC
+  // bin is left out
+  float *power = frame;
+  power[0] = 0.f;
+  for (int b = 1; b < ANALYZER_FFT_SIZE / 2; b++) {
+    power[b] =
+        frame[2 * b] * frame[2 * b] + frame[2 * b + 1] * frame[2 * b + 1];
+  }
+
+  int loudest = 1;
+  for (int b = 2; b < ANALYZER_FFT_SIZE / 2; b++) {
+    if (power[b] > power[loudest]) {
+      loudest = b;
+    }
+  }
+
+  // Parabolic interpolation of the log power around the loudest bin
+  float offset = 0.f;
+  if (loudest > 1 && loudest < ANALYZER_FFT_SIZE / 2 - 1) {
+    float left = logf(power[loudest - 1] + 1e-20f);
+    float center = logf(power[loudest] + 1e-20f);
+    float right = logf(power[loudest + 1] + 1e-20f);
+    float curve = left - 2.f * center + right;
+    if (curve < 0.f) {
+      offset = 0.5f * (left - right) / curve;
+    }
+  }
+  float f0 = (loudest + offset) * BIN_HZ;
+  float fundamental = partial_power(power, f0);
+
+  // Harmonics under the Nyquist frequency are distortion, the ones above
+  // fold back. A folded harmonic that lands on a harmonic cannot be told
+  // apart from it and is left out
+  const float nyquist = SAMPLE_FREQUENCY / 2.f;
+  float harmonics = 0.f;
+  float aliases = 0.f;
+  for (int k = 2; k <= ANALYZER_HARMONICS; k++) {
+    float freq = k * f0;
+    if (freq <= nyquist) {
+      harmonics += partial_power(power, freq);
+      continue;
+    }
+
+    freq = fmodf(freq, (float)SAMPLE_FREQUENCY);
+    if (freq > nyquist) {
+      freq = SAMPLE_FREQUENCY - freq;
+    }
+    float distance = fabsf(freq - f0 * roundf(freq / f0));
+    if (distance > (2 * LOBE_BINS + 1) * BIN_HZ) {
+      aliases += partial_power(power, freq);
+    }
+  }
+
+  // Median bin, most bins of a few partials only hold noise. The powers are
+  // reordered, they are not read afterwards
+  const int n_bins = ANALYZER_FFT_SIZE / 2 - 1;
+  std::nth_element(power + 1, power + 1 + n_bins / 2, power + 1 + n_bins);
+  float noise_floor = power[1 + n_bins / 2];
+
+  uint32_t thd = (uint32_t)(sqrtf(harmonics / fundamental) * 1000.f + 0.5f);
+  uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+  printuln("[Analyzer] peak %d dBFS, %u clips, floor %d dBFS, f0 %u Hz, "
+           "THD %u.%u%%, alias %d dB, %u us",
+           (int)lroundf(20.f * log10f(peak / 32768.f)), clips,
+           power_db(noise_floor / FULL_SCALE_POWER), (uint32_t)(f0 + 0.5f),
+           thd / 10, thd % 10, power_db(aliases / fundamental), us);
+}
+
+/// @brief Analyzer thread entry point
+static void analyzer_entry(void *, void *, void *) {
+  while (1) {
+    k_sem_take(&analyzer_ready, K_FOREVER);
+    analyze();
+    atomic_clear(&analyzer_busy);
+  }
+}
+#endif
+
+void analyzer_init() {
+#if ANALYZER_ENABLED
+  arm_cfft_init_f32(&cfft, ANALYZER_FFT_SIZE / 2);
+  k_thread_create(&analyzer_thread, analyzer_stack,
+                  K_THREAD_STACK_SIZEOF(analyzer_stack), analyzer_entry, NULL,
+                  NULL, NULL, ANALYZER_PRIORITY, K_FP_REGS, K_NO_WAIT);
+  k_thread_name_set(&analyzer_thread, "analyzer");
+#endif
+}
+
+void analyzer_capture(const int16_t *block) {
+#if ANALYZER_ENABLED
+  if (++analyzer_blocks < ANALYZER_PERIOD_BLOCKS) {
+    return;
+  }
+
+  // A block is skipped while the previous one is still being analyzed
+  if (!atomic_cas(&analyzer_busy, 0, 1)) {
+    return;
+  }
+  analyzer_blocks = 0;
+
+  memcpy(capture, block, sizeof(capture));
+  k_sem_give(&analyzer_ready);
+#else
+  ARG_UNUSED(block);
+#endif
+}
@@ -0,0 +1,41 @@
+#ifndef ANALYZER_H
+#define ANALYZER_H
+
+#include <stdint.h>
+
+/**
+ * Output analyzer
+ *
+ * Every ANALYZER_PERIOD_BLOCKS blocks, the audio loop copies the rendered
+ * block for a thread at the lowest application priority, which only runs
+ * while the audio loop sleeps between two blocks. The thread measures the
+ * block and its spectrum and prints one line:
+ *   [Analyzer] peak -6 dBFS, 0 clips, floor -98 dBFS, f0 440 Hz,
+ *   THD 1.2%, alias -71 dB, 812 us
+ * The floor is the median bin level. f0 is the loudest partial, the THD sums
+ * its harmonics under the Nyquist frequency and the aliasing sums the ones
+ * above it, at the frequencies they fold back to, relative to f0.
+ */
+
+// Set to 0 to build without the analyzer thread
+#define ANALYZER_ENABLED (1)
+
+/// @brief Blocks between two analyzed blocks, 100 blocks = 5 s
+#define ANALYZER_PERIOD_BLOCKS (100)
+
+/// @brief FFT length, taken from the start of the block
+#define ANALYZER_FFT_SIZE (2048)
+
+/// @brief Harmonics of f0 checked for distortion and aliasing
+#define ANALYZER_HARMONICS (32)
+
+/// @brief Start the analyzer thread
+void analyzer_init();
+
+/// @brief Hand a rendered block to the analyzer
+/// Only copies the block, every ANALYZER_PERIOD_BLOCKS calls and when the
+/// previous analysis is over. Call it from the audio loop after rendering
+/// @param block the rendered block, SAMPLES_PER_BLOCK samples
+void analyzer_capture(const int16_t *block);
+
+#endif // ANALYZER_H
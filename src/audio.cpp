@@ -1,9 +1,11 @@
 #include "audio.h"
+#include "i2c.h"
+#include "trace.h"
 #include "usb.h"
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
 #include <zephyr/drivers/gpio.h>
-#include <zephyr/drivers/i2c.h>
 #include <zephyr/drivers/i2s.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
@@ -21,46 +23,81 @@ K_MEM_SLAB_DEFINE_STATIC(mem_slab, BLOCK_SIZE, BLOCK_COUNT, BYTES_PER_SAMPLE);
 static const struct gpio_dt_spec cs = GPIO_DT_SPEC_GET(AUDIO_CS, gpios);
 const struct device *const i2s_dev_tx = DEVICE_DT_GET(I2S_TX_NODE);
 
-static int read(uint8_t devaddr, uint8_t regaddr, uint8_t *regval) {
-  int ret;
-
-  const struct device *dev = DEVICE_DT_GET(DT_NODELABEL(i2c1));
-
-  if (!device_is_ready(dev)) {
-    printuln("Device not ready");
-    return -ENODEV;
-  }
-
-  ret = i2c_write_read(dev, devaddr, &regaddr, 1, regval, 1);
-  if (ret) {
-    printuln("Call `i2c_write_read` failed: %d", ret);
-    return ret;
+// Codec initialization thread, above the main thread so that it resumes as
+// soon as an I2C transfer completes
+#define CODEC_STACK_SIZE 1024
+#define CODEC_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+K_THREAD_STACK_DEFINE(codec_stack, CODEC_STACK_SIZE);
+static struct k_thread codec_thread;
+// Longest wait for the configuration writes
+#define CODEC_TIMEOUT_MS 100
+static int codec_result;
+// Set while the codec thread runs, the volume is then left to it
+static volatile bool codec_busy = false;
+
+// I2C address of the codec
+#define CODEC_ADDR 0x4A
+
+// Shadow of the codec registers, a write of the value a register already
+// holds is skipped
+static uint8_t codec_regs[256];
+static uint32_t codec_known[256 / 32];
+// I2C write errors the shadow accounts for
+static uint32_t codec_errors = 0;
+
+// Codec configuration, register and value pairs written in order
+static const uint8_t CODEC_INIT[][2] = {
+    {0x02, 0x01}, // power save registers -> all on
+    {0x00, 0x99},
+    {0x47, 0x80},     // inits
+    {0x0d, 0x03},     // playback ctrl
+    {0x32, (1 << 7)}, // vol
+    {0x32, (0 << 7)}, // vol
+    {0x00, 0x00},     // inits
+    {0x04, 0xaf},     // power ctrl
+    {0x0d, 0x70},
+    {0x05, 0x81}, // clocking: auto speed is determined by the MCLK/LRCK ratio.
+    {0x06, 0x07}, // DAC interface format, I²S 16 bit
+    {0x0a, 0x00},
+    {0x27, 0x00},
+    {0x80, 0x0a}, // both channels on
+    {0x1f, 0x0f},
+    {0x22, (uint8_t)(4 - 80)},
+    {0x23, (uint8_t)(4 - 80)}, // limit headphone volume
+    {0x02, 0x9e},
+};
+
+/// @brief Queue a codec register write, unless the register holds the value
+/// The shadow is updated when the write is queued. A write that fails
+/// afterwards, in the I2C thread, invalidates the whole shadow: the failed
+/// transfer is not known, any queued register may have kept its old value
+/// @param regaddr the codec's register address
+/// @param regval the value to write
+/// @return 0 on success, -ERRNO otherwise
+static int codec_write(uint8_t regaddr, uint8_t regval) {
+  uint32_t errors = i2cWriteErrors();
+  if (errors != codec_errors) {
+    codec_errors = errors;
+    memset(codec_known, 0, sizeof(codec_known));
   }
 
-  return 0;
-}
-
-static int write(uint8_t devaddr, uint8_t regaddr, uint8_t regval) {
-  int ret;
-
-  const struct device *dev = DEVICE_DT_GET(DT_NODELABEL(i2c1));
-
-  if (!device_is_ready(dev)) {
-    printuln("Device not ready");
-    return -ENODEV;
+  uint32_t bit = 1u << (regaddr % 32);
+  if ((codec_known[regaddr / 32] & bit) && codec_regs[regaddr] == regval) {
+    return 0;
   }
 
-  uint8_t buf[2] = {regaddr, regval};
-
-  ret = i2c_write(dev, buf, 2, devaddr);
+  int ret = i2cWrite(CODEC_ADDR, regaddr, regval);
   if (ret) {
-    printuln("Call `i2c_write` failed: %d", ret);
+    codec_known[regaddr / 32] &= ~bit;
     return ret;
   }
-
+  codec_regs[regaddr] = regval;
+  codec_known[regaddr / 32] |= bit;
   return 0;
 }
 
+static int writeVolume(uint8_t volumeValue);
+
 void *allocBlock() {
   void *mem_block;
   int ret = k_mem_slab_alloc(&mem_slab, &mem_block, K_FOREVER);
@@ -93,33 +130,22 @@ int initAudio() {
     return ret;
   }
 
+  // Queued as one batch, sent while this thread sleeps. The writes stop at
+  // the first error, which is the one reported
   ret = 0;
-  ret |= write(0x4A, 0x02, 0x01); // power save registers -> all on
-  ret |= write(0x4A, 0x00, 0x99);
-  ret |= write(0x4A, 0x47, 0x80);     // inits
-  ret |= write(0x4A, 0x0d, 0x03);     // playback ctrl
-  ret |= write(0x4A, 0x32, (1 << 7)); // vol
-  ret |= write(0x4A, 0x32, (0 << 7)); // vol
-  ret |= write(0x4A, 0x00, 0x00);     // inits
-  ret |= write(0x4A, 0x04, 0xaf);     // power ctrl
-  ret |= write(0x4A, 0x0d, 0x70);
-  ret |=
-      write(0x4A, 0x05,
-            0x81); // clocking: auto speed is determined by the MCLK/LRCK ratio.
-  ret |= write(0x4A, 0x06, 0x07); // DAC interface format, I²S 16 bit
-  ret |= write(0x4A, 0x0a, 0x00);
-  ret |= write(0x4A, 0x27, 0x00);
-  ret |= write(0x4A, 0x80, 0x0a); // both channels on
-  ret |= write(0x4A, 0x1f, 0x0f);
-  ret |= write(0x4A, 0x22, 4 - 80);
-  ret |= write(0x4A, 0x23, 4 - 80); // limit headphone volume
-  ret |= write(0x4A, 0x02, 0x9e);
+  int n = sizeof(CODEC_INIT) / sizeof(CODEC_INIT[0]);
+  for (int i = 0; i < n && ret == 0; i++) {
+    ret = codec_write(CODEC_INIT[i][0], CODEC_INIT[i][1]);
+  }
+  if (ret == 0) {
+    ret = i2cFlush(CODEC_TIMEOUT_MS);
+  }
   if (ret < 0) {
     printuln("Failed to write config over i2c.");
     return ret;
   }
 
-  ret = setVolume(80);
+  ret = writeVolume(80);
   if (ret < 0) {
     printuln("Failed to set initial volume");
   }
@@ -150,7 +176,38 @@ int initAudio() {
   return 0;
 }
 
+/// @brief Codec initialization thread entry point
+static void codec_entry(void *, void *, void *) { codec_result = initAudio(); }
+
+int initAudioAsync() {
+  codec_busy = true;
+  k_thread_create(&codec_thread, codec_stack,
+                  K_THREAD_STACK_SIZEOF(codec_stack), codec_entry, NULL, NULL,
+                  NULL, CODEC_PRIORITY, 0, K_NO_WAIT);
+  return 0;
+}
+
+int waitForAudio() {
+  if (!codec_busy) {
+    return codec_result;
+  }
+
+  k_thread_join(&codec_thread, K_FOREVER);
+  codec_busy = false;
+  return codec_result;
+}
+
 int setVolume(uint8_t volumeValue) {
+  // The register shadow belongs to the codec initialization until it is over
+  if (codec_busy) {
+    return -EAGAIN;
+  }
+
+  return writeVolume(volumeValue);
+}
+
+/// @brief Write the volume registers of the codec
+static int writeVolume(uint8_t volumeValue) {
   int8_t vol;
   if (volumeValue > 100)
     volumeValue = 100;
@@ -160,9 +217,11 @@ int setVolume(uint8_t volumeValue) {
 
   vol = -90 + (float)80 * volumeValue / 100;
 
-  int ret = 0;
-  ret |= write(0x4A, 0x20, vol);
-  ret |= write(0x4A, 0x21, vol);
+  // Queued, the audio loop never waits for the bus
+  int ret = codec_write(0x20, vol);
+  if (ret == 0) {
+    ret = codec_write(0x21, vol);
+  }
   if (ret < 0) {
     printuln("Failed to set volume.");
     return -1;
@@ -175,7 +234,9 @@ int writeBlock(void *mem_block) {
 
   !i2s_trigger(i2s_dev_tx, I2S_DIR_TX, I2S_TRIGGER_START);
 
+  TRACE(TRACE_I2S_START, 0, 0, 0);
   ret = i2s_write(i2s_dev_tx, mem_block, BLOCK_SIZE);
+  TRACE(TRACE_I2S_END, 0, 0, ret);
   if (ret < 0) {
     printuln("Failed to write block %p: %d", mem_block, ret);
     if (ret == -5) {
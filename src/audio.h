@@ -35,6 +35,17 @@
 /// @return 0 on success, -ERRNO otherwise
 int initAudio();
 
+/// @brief Start the audio initialization in its own thread
+/// The codec is configured over I2C while the caller initializes the rest of
+/// the application. Call waitForAudio() before any other function from this
+/// library, setVolume() fails with -EAGAIN until then
+/// @return 0 on success, -ERRNO otherwise
+int initAudioAsync();
+
+/// @brief Wait for the audio initialization started by initAudioAsync()
+/// @return the result of initAudio()
+int waitForAudio();
+
 /// @brief Set the output volume/amplitude of the audio amplifier
 /// @param volumeValue volume value, from 0 to 255
 /// @return 0 on success, -ERRNO otherwise
@@ -0,0 +1,491 @@
+#include "bench.h"
+
+#include <zephyr/kernel.h>
+
+#include "audio.h"
+#include "chorus.hpp"
+#include "delay.hpp"
+#include "key.hpp"
+#include "reverb.hpp"
+#include "synth.hpp"
+#include "unison.hpp"
+#include "waveshaper.hpp"
+#include "usb.h"
+
+// Keeps the benchmarked results alive
+static volatile int bench_sink;
+
+// Boot phases, with the cycle counter at their end
+static const char *boot_names[BOOT_MAX_PHASES];
+static uint32_t boot_cycles[BOOT_MAX_PHASES];
+static int boot_count = 0;
+
+void bench_start(bench_t *bench) { bench->start = k_cycle_get_32(); }
+
+void bench_stop(bench_t *bench) {
+  // Unsigned subtraction handles a single counter wrap-around
+  uint32_t elapsed = k_cycle_get_32() - bench->start;
+
+  bench->last = elapsed;
+  bench->total += elapsed;
+  bench->count++;
+  if (elapsed > bench->max) {
+    bench->max = elapsed;
+  }
+}
+
+void bench_report(bench_t *bench) {
+  if (bench->count == 0) {
+    return;
+  }
+
+  uint32_t avg = (uint32_t)(bench->total / bench->count);
+  uint64_t period = (uint64_t)sys_clock_hw_cycles_per_sec() *
+                    BLOCK_GEN_PERIOD_MS / 1000;
+
+  // Load in tenths of a percent of the block period
+  uint32_t avg_load = (uint32_t)((uint64_t)avg * 1000 / period);
+  uint32_t max_load = (uint32_t)((uint64_t)bench->max * 1000 / period);
+
+  printuln("[Bench] %s: avg %u max %u cycles, load avg %u.%u%% max %u.%u%%",
+           bench->name, avg, bench->max, avg_load / 10, avg_load % 10,
+           max_load / 10, max_load % 10);
+
+  bench->total = 0;
+  bench->count = 0;
+  bench->max = 0;
+}
+
+void boot_phase(const char *name) {
+  if (boot_count < BOOT_MAX_PHASES) {
+    boot_names[boot_count] = name;
+    boot_cycles[boot_count] = k_cycle_get_32();
+    boot_count++;
+  }
+}
+
+void boot_report() {
+  uint32_t previous = 0;
+
+  // The cycle counter starts at boot and only wraps after about 25 s
+  for (int i = 0; i < boot_count; i++) {
+    printuln("[Boot] %s: %u us (+%u us)", boot_names[i],
+             k_cyc_to_us_floor32(boot_cycles[i]),
+             k_cyc_to_us_floor32(boot_cycles[i] - previous));
+    previous = boot_cycles[i];
+  }
+}
+
+/// @brief Print the cost of a kernel run over one block
+/// @param name the kernel name
+/// @param copies number of voices, copies or channels rendered by the kernel
+/// @param cycles cycles taken to render one block
+static void report_kernel(const char *name, int copies, uint32_t cycles) {
+  uint32_t per_sample = cycles / SAMPLES_PER_BLOCK;
+
+  printuln("[Bench] %s x%d: %u cycles/sample, %u per copy", name, copies,
+           per_sample, per_sample / copies);
+}
+
+static void bench_unison() {
+  // Reference: a single scalar sawtooth phase accumulator
+  uint16_t phase = 0;
+  int acc = 0;
+  uint32_t start = k_cycle_get_32();
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+    phase += 653;
+    acc += phase - 0x8000;
+  }
+  bench_sink = acc;
+  report_kernel("saw scalar", 1, k_cycle_get_32() - start);
+
+  for (int voices = 2; voices <= UNISON_MAX_VOICES; voices *= 2) {
+    unison_t params = {};
+    params.voices = voices;
+    params.detune = 25.;
+    params.mix = 0.5;
+    unison_update(params);
+
+    Unison unison;
+    unison.set_increment(653 << 16, params);
+
+    acc = 0;
+    start = k_cycle_get_32();
+    for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+      acc += unison.render_saw(params);
+    }
+    bench_sink = acc;
+    report_kernel("unison saw", voices, k_cycle_get_32() - start);
+  }
+}
+
+uint32_t bench_render_voices(int voices) {
+  static uint8_t block[BLOCK_SIZE];
+
+  for (int j = 0; j < voices; j++) {
+    synth.start_voice(keys[j], 48 + 7 * j);
+    synth.hold(keys[j], 10000);
+  }
+
+  uint32_t start = k_cycle_get_32();
+  synth.makesynth(block);
+  uint32_t cycles = k_cycle_get_32() - start;
+
+  for (int j = 0; j < voices; j++) {
+    keys[j].state = IDLE;
+  }
+
+  return cycles;
+}
+
+static void bench_voice_core() {
+  uint8_t oversampling = synth._oversampling;
+  osc_t osc1 = synth._osc1;
+
+  // Sawtooth on oscillator 1 only, the wave that folds back the most
+  synth._osc1.wave = sawtooth;
+  synth._osc1.enabled = true;
+
+  for (uint8_t factor = 1; factor <= QUALITY_OVERSAMPLING; factor *= 2) {
+    synth.set_oversampling(factor);
+
+    // Per voice cost above the block without voices (effects, clamp)
+    uint32_t empty = bench_render_voices(0);
+    for (int voices = 1; voices <= MAX_KEYS; voices++) {
+      report_kernel(factor == 1 ? "voices 1x" : "voices 2x", voices,
+                    bench_render_voices(voices) - empty);
+    }
+  }
+
+  synth.set_oversampling(oversampling);
+  synth._osc1 = osc1;
+  synth._last_voice = nullptr;
+  synth._pitch.last_increment = 0.;
+}
+
+static void bench_fm() {
+  osc_t osc1 = synth._osc1;
+  osc_t osc2 = synth._osc2;
+  fm_t fm = synth._fm;
+  int32_t fm_index = synth._fm_index;
+
+  // Sine carrier and modulator, all keys held
+  synth._osc1.wave = sine;
+  synth._osc1.enabled = true;
+  synth._osc2.wave = sine;
+  synth._osc2.enabled = true;
+
+  uint32_t empty = bench_render_voices(0);
+  uint32_t cycles[2];
+  for (int mode = 0; mode < 2; mode++) {
+    // The smoothing is skipped, the index is at its target from the start
+    synth._fm.index = mode * FM_INDEX_ENC_MAX / 2 * FM_INDEX_PER_STEP;
+    synth._fm_index = synth._fm.index;
+    cycles[mode] = bench_render_voices(MAX_KEYS) - empty;
+    report_kernel(mode == 0 ? "two oscillators mixed" : "two oscillators FM",
+                  MAX_KEYS, cycles[mode]);
+  }
+  printuln("[Bench] FM costs %u%% of the plain mix per voice",
+           (uint32_t)((uint64_t)cycles[1] * 100 / cycles[0]));
+
+  synth._osc1 = osc1;
+  synth._osc2 = osc2;
+  synth._fm = fm;
+  synth._fm_index = fm_index;
+  synth._last_voice = nullptr;
+  synth._pitch.last_increment = 0.;
+}
+
+/// @brief Cycles of a kernel over one block, all keys held, without the
+/// control ticks
+static uint32_t time_kernel(render_kernel_t kernel) {
+  static float out[CONTROL_PERIOD];
+
+  uint32_t start = k_cycle_get_32();
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i += CONTROL_PERIOD) {
+    (synth.*kernel)(out, CONTROL_PERIOD);
+  }
+  uint32_t cycles = k_cycle_get_32() - start;
+
+  bench_sink = (int)out[0];
+  return cycles;
+}
+
+static void bench_render_kernels() {
+  static const char *const WAVE_NAMES[N_KERNEL_WAVES] = {
+      "sine", "triangle", "square", "sawtooth", "wavetable", "off"};
+
+  osc_t osc1 = synth._osc1;
+  osc_t osc2 = synth._osc2;
+  Filter lpf = synth._lpf;
+
+  for (int j = 0; j < MAX_KEYS; j++) {
+    synth.start_voice(keys[j], 48 + 7 * j);
+    synth.hold(keys[j], 10000);
+  }
+
+  int count = 0;
+  uint64_t generic_total = 0;
+  uint64_t kernel_total = 0;
+  for (int w1 = 0; w1 < N_KERNEL_WAVES; w1++) {
+    for (int w2 = 0; w2 < N_KERNEL_WAVES; w2++) {
+      for (int filter = 0; filter < 2; filter++) {
+        synth._osc1.enabled = w1 != KERNEL_WAVE_OFF;
+        synth._osc1.wave = (wavetype_t)(w1 % KERNEL_WAVE_OFF);
+        synth._osc2.enabled = w2 != KERNEL_WAVE_OFF;
+        synth._osc2.wave = (wavetype_t)(w2 % KERNEL_WAVE_OFF);
+        synth._lpf._cutoff_enc = filter ? 48 : 0;
+        synth._dirty |= DIRTY_FILTER;
+
+        render_kernel_t kernel = synth.select_kernel();
+        if (kernel == &Synthesizer::render_generic) {
+          continue;
+        }
+
+        // Gains, increments, filter coefficients and wavetable frames
+        synth.control_tick();
+        uint32_t generic = time_kernel(&Synthesizer::render_generic);
+        uint32_t specialized = time_kernel(kernel);
+
+        printuln("[Bench] kernel %s/%s%s: %u -> %u cycles per block",
+                 WAVE_NAMES[w1], WAVE_NAMES[w2], filter ? " filter" : "",
+                 generic, specialized);
+        count++;
+        generic_total += generic;
+        kernel_total += specialized;
+      }
+    }
+  }
+
+  if (count > 0) {
+    printuln("[Bench] %d render kernels save %u%% of the generic kernel, "
+             "see tools/kernel_sizes.sh for their size",
+             count,
+             (uint32_t)(100 - kernel_total * 100 / generic_total));
+  }
+
+  for (int j = 0; j < MAX_KEYS; j++) {
+    keys[j].state = IDLE;
+  }
+  synth._osc1 = osc1;
+  synth._osc2 = osc2;
+  synth._lpf = lpf;
+  synth._dirty |= DIRTY_FILTER;
+  synth._last_voice = nullptr;
+  synth._pitch.last_increment = 0.;
+}
+
+/// @brief Fill the effect benchmark block with a ramp
+/// @return the block
+static int16_t *fill_effect_block() {
+  static int16_t block[SAMPLES_PER_BLOCK];
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+    block[i] = (int16_t)(i * 37);
+  }
+  return block;
+}
+
+/// @brief Print the share of the block deadline taken by an effect
+/// @param name the effect name
+/// @param cycles cycles taken to process one block
+static void report_effect_load(const char *name, uint32_t cycles) {
+  uint64_t period =
+      (uint64_t)sys_clock_hw_cycles_per_sec() * BLOCK_GEN_PERIOD_MS / 1000;
+
+  // In tenths of a percent
+  uint32_t load = (uint32_t)((uint64_t)cycles * 1000 / period);
+  printuln("[Bench] %s: %u cycles per block, %u.%u%% of the block period",
+           name, cycles, load / 10, load % 10);
+}
+
+static void bench_shaper() {
+  // Filter states and work buffers, 2.5 KB, too much for the main stack
+  static Waveshaper shaper;
+
+  for (int factor_enc = 0; factor_enc <= 2; factor_enc++) {
+    int16_t *block = fill_effect_block();
+
+    shaper_t params = {};
+    params.drive_enc = 16;
+    params.level_enc = 32;
+    params.factor_enc = factor_enc;
+    shaper_update(params);
+
+    uint32_t start = k_cycle_get_32();
+    shaper.process(block, SAMPLES_PER_BLOCK, params);
+    uint32_t cycles = k_cycle_get_32() - start;
+    bench_sink = block[0];
+
+    // Cost against quality: every factor doubles the shaped samples and adds
+    // a resampling stage, the cost per copy is per shaped sample
+    report_kernel("distortion", params.factor, cycles);
+    report_effect_load("distortion", cycles);
+  }
+}
+
+static void bench_chorus() {
+  int16_t *block = fill_effect_block();
+
+  chorus_t params = {};
+  params.rate_enc = 47; // fastest sweep
+  params.depth_enc = 32;
+  params.mix_enc = 16;
+  params.delay_enc = 20;
+  params.feedback_enc = 16;
+  chorus_update(params);
+
+  // Shares the synthesizer's line, which is cleared again by the first run of
+  // either chorus
+  Chorus chorus;
+  chorus.process(block, SAMPLES_PER_BLOCK, params);
+
+  uint32_t start = k_cycle_get_32();
+  chorus.process(block, SAMPLES_PER_BLOCK, params);
+  uint32_t cycles = k_cycle_get_32() - start;
+  bench_sink = block[0];
+
+  report_kernel("chorus", 1, cycles);
+  report_effect_load("chorus", cycles);
+}
+
+static void bench_delay() {
+  int16_t *block = fill_effect_block();
+
+  delay_t params = {};
+  params.time_enc = 50; // 500 ms, the run wraps the read position once
+  params.feedback_enc = 16;
+  params.mix_enc = 16;
+  params.damping_enc = 8;
+  delay_update(params);
+
+  // Shares the synthesizer's line, which is cleared again by the first run of
+  // either delay
+  Delay delay;
+  delay.process(block, SAMPLES_PER_BLOCK, params);
+
+  uint32_t start = k_cycle_get_32();
+  delay.process(block, SAMPLES_PER_BLOCK, params);
+  uint32_t cycles = k_cycle_get_32() - start;
+  bench_sink = block[0];
+
+  // The cost per sample does not depend on the delay time, the RAM does
+  report_kernel("delay", 1, cycles);
+  printuln("[Bench] delay: %u cycles per second of audio, line %u B "
+           "(%u ms), %u B per second of delay",
+           cycles * (SAMPLE_FREQUENCY / SAMPLES_PER_BLOCK),
+           (unsigned int)sizeof(delay_line), DELAY_MAX_MS,
+           (unsigned int)(SAMPLE_FREQUENCY * sizeof(int16_t)));
+}
+
+#if REVERB_ENABLED
+static void bench_reverb() {
+  int16_t *block = fill_effect_block();
+
+  reverb_t params = {};
+  params.room_enc = 32;
+  params.damping_enc = 16;
+  params.mix_enc = 16;
+  reverb_update(params);
+
+  // Shares the synthesizer's lines, which are cleared again by the first
+  // run of either reverb
+  Reverb reverb;
+  reverb.process(block, SAMPLES_PER_BLOCK, params);
+
+  uint32_t start = k_cycle_get_32();
+  reverb.process(block, SAMPLES_PER_BLOCK, params);
+  uint32_t cycles = k_cycle_get_32() - start;
+  bench_sink = block[0];
+
+  report_kernel("reverb", 1, cycles);
+  report_effect_load("reverb", cycles);
+  printuln("[Bench] reverb: lines %u B", (unsigned int)sizeof(reverb_lines));
+}
+#endif
+
+/// @brief LPF coefficients as computed before the DSP went single precision:
+/// the double constants promote every operation to a soft-float call
+static void filter_coefficients_double(float cutoff, float resonance,
+                                       float *a, float *b) {
+  float ita = 1.0 / tanf(3.14159265358979323846 * cutoff);
+  float q = 1.0 / resonance;
+
+  a[0] = 1.0 / (1.0 + (q * ita) + (ita * ita));
+  a[1] = 2 * a[0];
+  a[2] = a[0];
+  b[0] = 2.0 * ((ita * ita) - 1.0) * a[0];
+  b[1] = -(1.0 - (q * ita) + (ita * ita)) * a[0];
+}
+
+/// @brief Oscillator gain target, before and after the single precision
+/// conversion of set_gain
+static float osc_gain_double(uint16_t volume, float level, float mod) {
+  float target = (float)volume / 40000.0 * level;
+  return mod > -1. ? target * (1. + mod) : 0.;
+}
+
+static float osc_gain_float(uint16_t volume, float level, float mod) {
+  float target = (float)volume / 40000.f * level;
+  return mod > -1.f ? target * (1.f + mod) : 0.f;
+}
+
+/// @brief Cost of the control rate float code with double constants, as it
+/// was, and in single precision, as the DSP sources now enforce (see dsp.h)
+static void bench_single_precision() {
+  // Every cutoff but the bypass, at the resonance encoder's range
+  const int calls = 95;
+  Filter lpf(SAMPLE_FREQUENCY, 0.f);
+  float a[3];
+  float b[2];
+
+  uint32_t start = k_cycle_get_32();
+  for (int i = 1; i <= calls; i++) {
+    filter_coefficients_double(CUTOFF_FREQUENCIES_96[i] / SAMPLE_FREQUENCY,
+                               BUTTERWORTH_Q + i / 8.f, a, b);
+  }
+  uint32_t before = k_cycle_get_32() - start;
+  bench_sink = (int)(b[0] * 1000);
+
+  start = k_cycle_get_32();
+  for (int i = 1; i <= calls; i++) {
+    lpf.set_parameters(CUTOFF_FREQUENCIES_96[i], BUTTERWORTH_Q + i / 8.f);
+  }
+  uint32_t after = k_cycle_get_32() - start;
+  bench_sink = (int)lpf.filter(1000.f);
+
+  printuln("[Bench] LPF coefficients: double %u -> float %u cycles per update",
+           before / calls, after / calls);
+
+  // One gain per oscillator, voice and control period
+  float sum = 0.f;
+  start = k_cycle_get_32();
+  for (int i = 1; i <= calls; i++) {
+    sum += osc_gain_double(i * i * 4, i / 96.f, i / 48.f - 1.f);
+  }
+  before = k_cycle_get_32() - start;
+
+  start = k_cycle_get_32();
+  for (int i = 1; i <= calls; i++) {
+    sum += osc_gain_float(i * i * 4, i / 96.f, i / 48.f - 1.f);
+  }
+  after = k_cycle_get_32() - start;
+  bench_sink = (int)sum;
+
+  printuln("[Bench] oscillator gain: double %u -> float %u cycles per gain",
+           before / calls, after / calls);
+}
+
+void bench_kernels() {
+  printuln("[Bench] Kernels, %d samples per run", SAMPLES_PER_BLOCK);
+  bench_unison();
+  bench_voice_core();
+  bench_fm();
+  bench_render_kernels();
+  bench_single_precision();
+  bench_shaper();
+  bench_chorus();
+  bench_delay();
+#if REVERB_ENABLED
+  bench_reverb();
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+// Number of measured sections between two reports, 100 blocks = 5 s
+#define BENCH_REPORT_PERIOD (100)
+
+// Set to 1 to run the DSP kernel benchmarks once at boot, they delay the
+// first audio block
+#define BENCH_KERNELS (0)
+
+/// @brief Cycle count statistics of a code section
+typedef struct bench {
+  const char *name;
+  uint32_t start;
+  uint32_t last;
+  uint32_t max;
+  uint64_t total;
+  uint32_t count;
+} bench_t;
+
+/// @brief Start measuring a section
+/// @param bench the section statistics
+void bench_start(bench_t *bench);
+
+/// @brief Stop measuring a section and accumulate the elapsed cycles
+/// @param bench the section statistics
+void bench_stop(bench_t *bench);
+
+/// @brief Print the section statistics and reset them
+/// The load is given relative to the block generation period
+/// @param bench the section statistics
+void bench_report(bench_t *bench);
+
+/// @brief Maximum number of recorded boot phases
+#define BOOT_MAX_PHASES (12)
+
+/// @brief Record the end of a boot phase
+/// @param name the phase name, a string literal
+void boot_phase(const char *name);
+
+/// @brief Print the time at which every boot phase ended
+void boot_report();
+
+/// @brief Render one block with the first keys held, then release them
+/// @param voices number of held keys, up to MAX_KEYS
+/// @return cycles taken by makesynth
+uint32_t bench_render_voices(int voices);
+
+/// @brief Benchmark the DSP kernels one block at a time and print the cost
+/// per sample. Call it once after initialization, before audio starts
+void bench_kernels();
+
+#endif // BENCH_H
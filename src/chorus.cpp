@@ -0,0 +1,88 @@
+#include "dsp.h"
+
+#include "chorus.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "effect.hpp"
+#include "memmap.h"
+
+// Read at a moving position every sample, zero wait states
+DSP_STATE int16_t chorus_line[CHORUS_LINE_SAMPLES];
+
+// Shortest delay, the interpolation reads the sample after the delayed one
+static const float CHORUS_MIN_DELAY = 2.;
+
+void chorus_update(chorus_t &chorus) {
+  // 0.05 Hz to 11 Hz, 6 steps per octave
+  chorus.rate = 0.05f * exp2f(chorus.rate_enc / 6.f);
+
+  // 0.5 ms steps, the swing never reaches below the shortest delay or past
+  // the end of the line
+  float center = SAMPLE_FREQUENCY / 2000.f * (chorus.delay_enc + 1);
+  float longest = CHORUS_LINE_SAMPLES - 2;
+  if (center > longest) {
+    center = longest;
+  }
+
+  float depth = center * chorus.depth_enc / 32;
+  if (center - depth < CHORUS_MIN_DELAY) {
+    depth = center - CHORUS_MIN_DELAY;
+  }
+  if (center + depth > longest) {
+    depth = longest - center;
+  }
+  chorus.center = center;
+  chorus.depth = depth < 0.f ? 0.f : depth;
+
+  chorus.feedback = chorus.feedback_enc * 1024;
+  chorus.mix = enc_level(chorus.mix_enc);
+}
+
+DSP_CODE void Chorus::process(int16_t *block, int n, const chorus_t &params,
+                              gain_ramp_t *ramp) {
+  if (!effect_switch(_active, params.mix != 0, [this, &params] {
+        memset(chorus_line, 0, sizeof(chorus_line));
+        _delay = (int32_t)(params.center * 65536.f);
+      })) {
+    return;
+  }
+
+  _lfo.set_frequency(params.rate);
+  _lfo.set_shape((lfo_shape_t)params.shape);
+
+  int32_t feedback = params.feedback;
+  int32_t mix = params.mix;
+
+  for (int base = 0; base < n; base += CHORUS_TICK) {
+    int count = n - base < CHORUS_TICK ? n - base : CHORUS_TICK;
+
+    // Next point of the trajectory, the delay ramps to it over the tick
+    _lfo.tick(count);
+    float target = params.center + params.depth * _lfo.get_sample();
+    int32_t step = ((int32_t)(target * 65536.f) - _delay) / count;
+
+    int32_t delay = _delay;
+    int write = _write;
+    int16_t *x = &block[base];
+
+    for (int i = 0; i < count; i++) {
+      delay += step;
+
+      // Linear interpolation between the two samples around the delay
+      int read = (write - (delay >> 16)) & CHORUS_LINE_MASK;
+      int32_t a = chorus_line[read];
+      int32_t b = chorus_line[(read - 1) & CHORUS_LINE_MASK];
+      int32_t delayed = a + (((b - a) * ((delay & 0xffff) >> 1)) >> 15);
+
+      int32_t in = x[i];
+      chorus_line[write] = sat16(in + ((delayed * feedback) >> 15));
+      x[i] = ramp_sample(ramp, sat16(in + ((delayed * mix) >> 15)));
+      write = (write + 1) & CHORUS_LINE_MASK;
+    }
+
+    _delay = delay;
+    _write = write;
+  }
+}
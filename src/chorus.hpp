@@ -0,0 +1,68 @@
+#ifndef CHORUS_H
+#define CHORUS_H
+
+#include "audio.h"
+#include "effect.hpp"
+#include "lfo.hpp"
+#include <stdint.h>
+
+/// @brief Length of the modulated line, a power of two so that the
+/// fractional reads wrap with a mask. 2048 samples = 46 ms, 4 KB in CCM
+const int CHORUS_LINE_SAMPLES = 2048;
+const int CHORUS_LINE_MASK = CHORUS_LINE_SAMPLES - 1;
+
+/// @brief Longest center delay, in 0.5 ms encoder steps
+const int CHORUS_MAX_DELAY_ENC = 50;
+
+/// @brief Samples between two points of the delay trajectory
+const int CHORUS_TICK = 64;
+
+/// @brief Modulated delay line
+extern int16_t chorus_line[CHORUS_LINE_SAMPLES];
+
+/// @brief Chorus/flanger parameters
+/// A chorus is a center delay of 10 to 25 ms without feedback, a flanger a
+/// delay of a few ms with feedback
+typedef struct chorus {
+  float rate;       // LFO frequency, in Hz
+  float center;     // center delay, in samples
+  float depth;      // delay swing on each side of the center, in samples
+  int16_t feedback; // level of the delayed signal fed back, Q15, signed
+  int16_t mix;      // level of the delayed signal in the output, Q15, 0 = off
+  uint8_t shape;    // LFO waveform, lfo_shape_t
+  int rate_enc;
+  int depth_enc;
+  int mix_enc;
+  int delay_enc;
+  int feedback_enc;
+} chorus_t;
+
+/// @brief Recompute the delays and levels after a parameter change
+/// @param chorus the chorus parameters
+void chorus_update(chorus_t &chorus);
+
+/// @brief Chorus/flanger, processed in place one block at a time
+/// The delay follows an LFO evaluated every CHORUS_TICK samples and ramped
+/// linearly in between, the reads are linearly interpolated between samples
+class Chorus {
+public:
+  LFO _lfo;
+  int _write;       // write position in the line
+  int32_t _delay;   // current delay, 16.16 samples
+  bool _active;     // the line holds audio of the current settings
+
+  /// @brief Default constructor, empty line
+  Chorus()
+      : _lfo{0., SAMPLE_FREQUENCY, LFO_MAX_AMPLITUDE, 0}, _write{0},
+        _delay{0}, _active{false} {}
+
+  /// @brief Add the modulated delay to a block
+  /// @param block the audio samples, modified in place
+  /// @param n number of samples
+  /// @param params the chorus parameters
+  /// @param ramp the master gain ramp if this is the last active stage
+  void process(int16_t *block, int n, const chorus_t &params,
+               gain_ramp_t *ramp = nullptr);
+};
+
+#endif // CHORUS_H
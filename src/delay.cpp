@@ -0,0 +1,126 @@
+#include "dsp.h"
+
+#include "delay.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "effect.hpp"
+#include "memmap.h"
+
+int16_t delay_line[DELAY_MAX_SAMPLES];
+
+/// @brief Tempo-synced delay time, in beats
+typedef struct division {
+  const char *name;
+  uint8_t beats_num;
+  uint8_t beats_den;
+} division_t;
+
+static const division_t DIVISIONS[N_DELAY_DIVISIONS] = {
+    {"1/16", 1, 4}, {"1/8T", 1, 3}, {"1/8", 1, 2}, {"1/8D", 3, 4},
+    {"1/4T", 2, 3}, {"1/4", 1, 1},  {"1/4D", 3, 2}, {"1/2", 2, 1},
+};
+
+/// @brief Delay time of a tempo division, from the sample clock
+/// @param division the division index, 1 to N_DELAY_DIVISIONS
+/// @param bpm the tempo
+/// @return the delay time in samples, halved until it fits the line
+static int division_length(int division, int bpm) {
+  const division_t &d = DIVISIONS[division - 1];
+
+  // Exact integer number of samples, the echoes do not drift off the tempo
+  int length = SAMPLE_FREQUENCY * 60 * d.beats_num / (bpm * d.beats_den);
+  while (length >= DELAY_MAX_SAMPLES) {
+    length /= 2;
+  }
+
+  return length;
+}
+
+void delay_update(delay_t &delay) {
+  // The synced times are the first positions of the time encoder
+  if (delay.sync && delay.time_enc > N_DELAY_DIVISIONS) {
+    delay.time_enc = N_DELAY_DIVISIONS;
+  }
+
+  if (delay.time_enc == 0) {
+    delay.length = 0;
+  } else if (delay.sync) {
+    delay.length = division_length(delay.time_enc, delay.bpm);
+  } else {
+    delay.length = SAMPLE_FREQUENCY * DELAY_MS_PER_STEP / 1000 * delay.time_enc;
+  }
+  if (delay.length >= DELAY_MAX_SAMPLES) {
+    delay.length = DELAY_MAX_SAMPLES - 1;
+  }
+
+  delay.feedback = delay.feedback_enc * 1024;
+  delay.mix = enc_level(delay.mix_enc);
+
+  // Feedback lowpass from 16 kHz down to 1 kHz, 8 steps per octave
+  float cutoff = 16000.f * exp2f(-delay.damping_enc / 8.f);
+  float a = 1.f - expf(-2.f * (float)M_PI * cutoff / SAMPLE_FREQUENCY);
+  delay.damping = (int16_t)(a * 32767.f);
+}
+
+const char *delay_time_name(const delay_t &delay) {
+  if (delay.sync && delay.time_enc > 0) {
+    return DIVISIONS[delay.time_enc - 1].name;
+  }
+  return "ms";
+}
+
+DSP_CODE void Delay::process(int16_t *block, int n, const delay_t &params,
+                             gain_ramp_t *ramp) {
+  int length = params.length;
+  if (!effect_switch(_active, length != 0, [this] {
+        memset(delay_line, 0, sizeof(delay_line));
+        _lowpass = 0;
+      })) {
+    return;
+  }
+
+  int32_t feedback = params.feedback;
+  int32_t mix = params.mix;
+  int32_t damping = params.damping;
+  int32_t lowpass = _lowpass;
+
+  while (n > 0) {
+    int read = _write - length;
+    if (read < 0) {
+      read += DELAY_MAX_SAMPLES;
+    }
+
+    // Longest run where neither position wraps
+    int count = n;
+    if (count > DELAY_MAX_SAMPLES - _write) {
+      count = DELAY_MAX_SAMPLES - _write;
+    }
+    if (count > DELAY_MAX_SAMPLES - read) {
+      count = DELAY_MAX_SAMPLES - read;
+    }
+
+    const int16_t *src = &delay_line[read];
+    int16_t *dst = &delay_line[_write];
+
+    for (int i = 0; i < count; i++) {
+      int32_t echo = src[i];
+      int32_t in = block[i];
+
+      // The repeats lose their highs, like a tape or bucket-brigade echo
+      lowpass += ((echo - lowpass) * damping) >> 15;
+      dst[i] = sat16(in + ((lowpass * feedback) >> 15));
+      block[i] = ramp_sample(ramp, sat16(in + ((echo * mix) >> 15)));
+    }
+
+    block += count;
+    n -= count;
+    _write += count;
+    if (_write == DELAY_MAX_SAMPLES) {
+      _write = 0;
+    }
+  }
+
+  _lowpass = lowpass;
+}
@@ -0,0 +1,73 @@
+#ifndef DELAY_H
+#define DELAY_H
+
+#include "audio.h"
+#include "effect.hpp"
+#include <stdint.h>
+
+/// @brief Longest delay time, in milliseconds
+/// The line costs 2 bytes per sample, 88200 B per second at 44.1 kHz
+#define DELAY_MAX_MS 750
+
+/// @brief Length of the delay line, in samples
+const int DELAY_MAX_SAMPLES = SAMPLE_FREQUENCY * DELAY_MAX_MS / 1000;
+
+/// @brief Delay time encoder steps, in milliseconds
+const int DELAY_MS_PER_STEP = 10;
+
+/// @brief Tempo range of the tempo sync, in beats per minute
+const int DELAY_MIN_BPM = 40;
+const int DELAY_MAX_BPM = 240;
+
+/// @brief Number of tempo-synced delay times
+const int N_DELAY_DIVISIONS = 8;
+
+/// @brief Delay line of the echo, in SRAM, too large for the CCM
+extern int16_t delay_line[DELAY_MAX_SAMPLES];
+
+/// @brief Delay parameters
+typedef struct delay {
+  uint16_t length;  // delay time, in samples, 0 = off
+  int16_t feedback; // level of the echo fed back into the line, Q15
+  int16_t mix;      // level of the echo in the output, Q15
+  int16_t damping;  // one-pole lowpass coefficient of the feedback, Q15
+  uint8_t bpm;      // tempo of the tempo sync
+  bool sync;        // the delay time is a division of the tempo
+  int time_enc;     // 0 = off, 10 ms steps or a division when synced
+  int feedback_enc;
+  int mix_enc;
+  int damping_enc;
+} delay_t;
+
+/// @brief Recompute the delay length and coefficients after a parameter
+/// change
+/// @param delay the delay parameters
+void delay_update(delay_t &delay);
+
+/// @brief Name of the delay time, for the logs
+/// @param delay the delay parameters
+/// @return the division when synced, "ms" otherwise
+const char *delay_time_name(const delay_t &delay);
+
+/// @brief Feedback delay, processed in place one block at a time
+/// The read and write positions are wrapped once per contiguous run instead
+/// of once per sample, so a block is split in at most three runs
+class Delay {
+public:
+  int _write;       // write position in the line
+  int32_t _lowpass; // feedback lowpass state
+  bool _active;     // the line holds audio of the current delay
+
+  /// @brief Default constructor, empty line
+  Delay() : _write{0}, _lowpass{0}, _active{false} {}
+
+  /// @brief Add the echo to a block and feed the block into the line
+  /// @param block the audio samples, modified in place
+  /// @param n number of samples
+  /// @param params the delay parameters
+  /// @param ramp the master gain ramp if this is the last active stage
+  void process(int16_t *block, int n, const delay_t &params,
+               gain_ramp_t *ramp = nullptr);
+};
+
+#endif // DELAY_H
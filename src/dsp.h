@@ -0,0 +1,25 @@
+#ifndef DSP_H
+#define DSP_H
+
+/**
+ * Single precision DSP
+ *
+ * The Cortex-M4 FPU only computes in single precision, every double operation
+ * is a soft-float library call costing tens of cycles. A double literal next
+ * to a float (x / 32., 1.0 / x) silently promotes the whole expression.
+ *
+ * The DSP sources include this header before anything else, so that an
+ * implicit float to double promotion in them or in the headers they pull in
+ * fails the build, as with -Wdouble-promotion -Werror. Use float literals
+ * (32.f) and float functions (expf, exp2f), and cast values printed with %f to
+ * double explicitly: printuln is variadic, the promotion is intended there.
+ */
+
+/// @brief Set to 0 to build the DSP sources without the check
+#define DSP_FLOAT_ONLY (1)
+
+#if DSP_FLOAT_ONLY && defined(__GNUC__)
+#pragma GCC diagnostic error "-Wdouble-promotion"
+#endif
+
+#endif // DSP_H
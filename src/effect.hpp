@@ -0,0 +1,78 @@
+#ifndef EFFECT_H
+#define EFFECT_H
+
+#include <stdint.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_math.h>
+#endif
+
+/**
+ * Helpers shared by the block effects: distortion, chorus, delay and reverb.
+ * They process int16 blocks in place with Q15 coefficients.
+ */
+
+/// @brief Saturate to the int16 range
+static inline int32_t sat16(int32_t x) {
+#if defined(__ARM_FEATURE_DSP)
+  return __SSAT(x, 16);
+#else
+  return x > 0x7fff ? 0x7fff : (x < -0x8000 ? -0x8000 : x);
+#endif
+}
+
+/// @brief Level of a mix or output level encoder, 1/32 per step
+/// @param enc the encoder position, 0 to 32
+/// @return the level, Q15, full scale at 32
+static inline int16_t enc_level(int enc) {
+  return enc < 32 ? enc * 1024 : 32767;
+}
+
+/// @brief Switch an effect with a line on or off before a block
+/// The lines of an effect that was off hold the tail of an earlier setting,
+/// which is not replayed: they are cleared the first block it is on again
+/// @param active whether the lines hold audio of the current settings
+/// @param on whether the effect processes the block
+/// @param clear empties the lines and the filter states
+/// @return on
+template <typename Clear>
+static inline bool effect_switch(bool &active, bool on, Clear clear) {
+  if (on && !active) {
+    clear();
+  }
+  active = on;
+  return on;
+}
+
+/// @brief Master gain ramped linearly across a block
+/// Applied by the last active stage in its final write rather than by a pass
+/// of its own. Q30, so that the step of a slow ramp does not round to 0
+typedef struct gain_ramp {
+  int32_t gain; // current gain, Q30, 1 << 30 is unity
+  int32_t step; // added after every sample
+} gain_ramp_t;
+
+/// @brief Ramp from one gain to another over a number of samples
+/// @param from the gain of the first sample, 0 to 1
+/// @param to the gain reached after the last sample, 0 to 1
+/// @param n number of samples
+/// @return the ramp
+static inline gain_ramp_t gain_ramp(float from, float to, int n) {
+  int32_t gain = (int32_t)(from * (1 << 30));
+  return {gain, ((int32_t)(to * (1 << 30)) - gain) / n};
+}
+
+/// @brief Scale a finished sample by the ramp, if any, and advance it
+/// @param ramp the ramp, nullptr when a later stage applies it
+/// @param x the sample
+/// @return the scaled sample, in range as the gain is at most 1
+static inline int32_t ramp_sample(gain_ramp_t *ramp, int32_t x) {
+  if (ramp == nullptr) {
+    return x;
+  }
+  int32_t y = (x * (ramp->gain >> 15)) >> 15;
+  ramp->gain += ramp->step;
+  return y;
+}
+
+#endif // EFFECT_H
@@ -0,0 +1,92 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <stdint.h>
+
+/// @brief Envelope stages
+typedef enum {
+  ENV_OFF,
+  ENV_ATTACK,
+  ENV_SUSTAIN,
+  ENV_RELEASE
+} envelope_stage_t;
+
+/// @brief Release step of a stolen voice, from full level to silence in 4
+/// control periods (6 ms): the key is free at once, without a click
+const float ENVELOPE_STEAL_STEP = 0.25f;
+
+/// @brief Amplitude envelope parameters shared by all voices
+/// Attack and release are linear, the envelope is evaluated at control rate
+typedef struct envelope {
+  float attack_step;  // level change per control period, 1 = instant
+  float sustain;      // sustain level, 0 to 1
+  float release_step; // level change per control period, 1 = instant
+  int attack_enc;
+  int sustain_enc;
+  int release_enc;
+} envelope_t;
+
+/// @brief Attack-sustain-release envelope of one key
+class Envelope {
+public:
+  envelope_stage_t _stage;
+  float _level;
+  bool _stolen; // fading out quickly to free the key for another note
+
+  /// @brief Default constructor, the envelope is off
+  Envelope() : _stage{ENV_OFF}, _level{0.}, _stolen{false} {}
+
+  /// @brief Restart the attack from silence
+  void trigger() {
+    _stage = ENV_ATTACK;
+    _level = 0.;
+    _stolen = false;
+  }
+
+  /// @brief Release with ENVELOPE_STEAL_STEP whatever the gate, until the
+  /// next trigger
+  void steal() { _stolen = true; }
+
+  /// @brief Advance the envelope by a control period
+  /// @param params the envelope parameters
+  /// @param gate true while the key is held
+  /// @return the envelope level, 0 to 1
+  float update(const envelope_t &params, bool gate) {
+    if (_stolen) {
+      gate = false;
+    }
+
+    // A held key that was released again restarts the attack from its level
+    if (gate && (_stage == ENV_RELEASE || _stage == ENV_OFF)) {
+      _stage = ENV_ATTACK;
+    } else if (!gate && _stage != ENV_OFF) {
+      _stage = ENV_RELEASE;
+    }
+
+    switch (_stage) {
+    case ENV_ATTACK:
+      _level += params.attack_step;
+      if (_level >= params.sustain) {
+        _level = params.sustain;
+        _stage = ENV_SUSTAIN;
+      }
+      break;
+    case ENV_SUSTAIN:
+      _level = params.sustain;
+      break;
+    case ENV_RELEASE:
+      _level -= _stolen ? ENVELOPE_STEAL_STEP : params.release_step;
+      if (_level <= 0.f) {
+        _level = 0.f;
+        _stage = ENV_OFF;
+      }
+      break;
+    case ENV_OFF:
+      break;
+    }
+
+    return _level;
+  }
+};
+
+#endif // ENVELOPE_H
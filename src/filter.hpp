@@ -1,7 +1,7 @@
 #include <math.h>
 #include <stdint.h>
 
-#define PI (3.14159265358979323846)
+#define PI (3.14159265358979323846f)
 
 // Filter discrete cut-off frequencies, 96-entry LUT
 const float CUTOFF_FREQUENCIES_96[] = {
@@ -37,12 +37,15 @@ const float CUTOFF_FREQUENCIES_96[] = {
 //   1490.632, 1644.083, 1813.330, 2000.000,
 // };
 
-// Implements second-order Butterworth low-pass filter
+/// @brief Quality factor of the Butterworth response, no resonance
+const float BUTTERWORTH_Q = 0.7071;
+
+// Implements second-order low-pass filter, Butterworth without resonance
 class Filter {
 public:
-  float _cutoff_freq;    // cutoff frequency of the LPF in Hz
-  int _cutoff_enc;       // cutoff frequency encoder state
-  float _resonance_freq; // TODO: implement
+  float _cutoff_freq; // cutoff frequency of the LPF in Hz
+  int _cutoff_enc;    // cutoff frequency encoder state, 0 bypasses the LPF
+  float _resonance;   // quality factor, Butterworth at 1/sqrt(2)
   int _resonance_enc;
 
 private:
@@ -57,6 +60,12 @@ private:
   float a[3] = {0., 0., 0.}; // input sample coefficients
   float b[2] = {0., 0.};     // previous output sample coefficients
 
+  // Coefficients for the current parameters, a glide ramps to them
+  float a_end[3] = {0., 0., 0.};
+  float b_end[2] = {0., 0.};
+  float a_step[3] = {0., 0., 0.}; // coefficient changes per sample
+  float b_step[2] = {0., 0.};
+
   /// @brief Update the filter coefficients from the encoder values
   /// Internal function called by the encoder's callback
   void update_coefficients() {
@@ -74,15 +83,15 @@ private:
 
     // float norm_freq = _cutoff_freq / sampling_freq;
 
-    float ita = 1.0 / tanf(PI * _cutoff_freq);
-    float q = sqrtf(2);
+    float ita = 1.f / tanf(PI * _cutoff_freq);
+    float q = 1.f / _resonance;
 
-    a[0] = 1.0 / (1.0 + (q * ita) + (ita * ita));
-    a[1] = 2 * a[0];
-    a[2] = a[0];
+    a_end[0] = 1.f / (1.f + (q * ita) + (ita * ita));
+    a_end[1] = 2 * a_end[0];
+    a_end[2] = a_end[0];
 
-    b[0] = 2.0 * ((ita * ita) - 1.0) * a[0];
-    b[1] = -(1.0 - (q * ita) + (ita * ita)) * a[0];
+    b_end[0] = 2.f * ((ita * ita) - 1.f) * a_end[0];
+    b_end[1] = -(1.f - (q * ita) + (ita * ita)) * a_end[0];
   }
 
 public:
@@ -93,11 +102,18 @@ public:
     this->sampling_freq = sampling_freq;
     this->_cutoff_enc = 0;
     this->_resonance_enc = 0;
+    this->_resonance = BUTTERWORTH_Q;
     set_cutoff_freq(cutoff_freq);
   }
 
-  // Applies the filter and updates the sampling window
+  // Applies the filter, advances a glide and updates the sampling window
   float filter(float curr_sample) {
+    for (int i = 0; i < 3; i++) {
+      a[i] += a_step[i];
+    }
+    b[0] += b_step[0];
+    b[1] += b_step[1];
+
     float y = a[0] * curr_sample + a[1] * prev_sample[0] +
               a[2] * prev_sample[1] + b[0] * prev_output[0] +
               b[1] * prev_output[1];
@@ -120,9 +136,57 @@ public:
     // Normalize the cutoff frequency to the sampling frequency
     _cutoff_freq = cutoff / sampling_freq;
     update_coefficients();
+    settle();
+  }
+
+  /// @brief End a glide, the coefficients take their final values
+  void settle() {
+    for (int i = 0; i < 3; i++) {
+      a[i] = a_end[i];
+      a_step[i] = 0.;
+    }
+    b[0] = b_end[0];
+    b[1] = b_end[1];
+    b_step[0] = 0.;
+    b_step[1] = 0.;
+  }
+
+  /// @brief Change the rate the filter runs at, keeping the cut-off frequency
+  /// @param freq the new sampling frequency
+  void set_sampling_freq(float freq) {
+    float cutoff = _cutoff_freq * sampling_freq;
+    sampling_freq = freq;
+    set_cutoff_freq(cutoff);
   }
 
-  /// @brief Sets the filter's resonance frequency
-  /// @param cutoff the filter's resonance frequency
-  void set_resonance_freq(float res) { _resonance_freq = res; }
+  /// @brief Get the rate the filter runs at
+  /// @return the sampling frequency
+  float get_sampling_freq() const { return sampling_freq; }
+
+  /// @brief Sets the filter's cut-off frequency and resonance at once
+  /// @param cutoff the filter's cut-off frequency
+  /// @param resonance the filter's quality factor
+  void set_parameters(float cutoff, float resonance) {
+    _resonance = resonance;
+    set_cutoff_freq(cutoff);
+  }
+
+  /// @brief Glide to a cut-off frequency and resonance over a number of
+  /// samples, by linear steps of the coefficients
+  /// The feedback pairs of two stable filters bound a convex region of
+  /// stable pairs, so every filter along the glide is stable
+  /// @param cutoff the filter's cut-off frequency at the end
+  /// @param resonance the filter's quality factor at the end
+  /// @param samples number of samples to glide over, call settle() after
+  void glide(float cutoff, float resonance, int samples) {
+    _resonance = resonance;
+    _cutoff_freq = cutoff / sampling_freq;
+    update_coefficients();
+
+    for (int i = 0; i < 3; i++) {
+      a_step[i] = (a_end[i] - a[i]) / samples;
+    }
+    b_step[0] = (b_end[0] - b[0]) / samples;
+    b_step[1] = (b_end[1] - b[1]) / samples;
+  }
 };
\ No newline at end of file
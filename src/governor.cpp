@@ -0,0 +1,389 @@
+#include "governor.hpp"
+
+#include <zephyr/kernel.h>
+
+#include "audio.h"
+#include "bench.h"
+#include "synth.hpp"
+#include "usb.h"
+
+Governor governor;
+
+/// @brief Render cost of an effect switched on, above the silent block
+/// The first block clears the effect's lines and is not measured
+/// @param base cycles of the silent block without effects
+/// @return the effect's cycles per block
+static uint32_t stage_cycles(uint32_t base) {
+  bench_render_voices(0);
+  uint32_t cycles = bench_render_voices(0);
+  return cycles > base ? cycles - base : 0;
+}
+
+/// @brief Calibration steps, one per block
+enum calibration_step {
+  CAL_VOICES_1X,
+  CAL_VOICES_2X,
+  CAL_SHAPER_1X,
+  CAL_SHAPER_2X,
+  CAL_SHAPER_4X,
+  CAL_CHORUS,
+  CAL_DELAY,
+  CAL_REVERB,
+  CAL_DONE
+};
+
+/// @brief Whether the effect a calibration step measures is on
+/// Its lines or filter states then hold audio that the measurement, on
+/// silence, would overwrite
+/// @param step the calibration step
+static bool measured_effect_on(int step) {
+  switch (step) {
+  case CAL_SHAPER_1X:
+  case CAL_SHAPER_2X:
+  case CAL_SHAPER_4X:
+    return synth._shaper.drive != 0;
+  case CAL_CHORUS:
+    return synth._chorus.mix != 0;
+  case CAL_DELAY:
+    return synth._delay.length != 0;
+#if REVERB_ENABLED
+  case CAL_REVERB:
+    return synth._reverb.wet != 0;
+#endif
+  default:
+    return false;
+  }
+}
+
+bool Governor::calibrated() const {
+#if GOVERNOR_ENABLED
+  return _step >= CAL_DONE;
+#else
+  return true;
+#endif
+}
+
+void Governor::calibrate_step() {
+#if GOVERNOR_ENABLED
+  // The voices are measured on the keys, a note played meanwhile waits. An
+  // effect is measured once it is off
+  if (calibrated() || sounding() > 0 || measured_effect_on(_step)) {
+    return;
+  }
+
+  if (_step == CAL_VOICES_1X) {
+    _period = (uint32_t)((uint64_t)sys_clock_hw_cycles_per_sec() *
+                         BLOCK_GEN_PERIOD_MS / 1000);
+    _budget = (uint32_t)((uint64_t)_period * GOVERNOR_BUDGET_PERCENT / 100);
+    _restore =
+        (uint32_t)((uint64_t)_period * GOVERNOR_RESTORE_PERCENT / 100);
+  }
+
+  // Audio is running: the state the measurements go through is restored, the
+  // filter and decimator included, so the next block does not click. The
+  // effects switched off meanwhile keep their lines, and resume their tails
+  // as if the measured blocks had not been rendered
+  uint8_t oversampling = synth._oversampling;
+  osc_t osc1 = synth._osc1;
+  osc_t osc2 = synth._osc2;
+  Filter lpf = synth._lpf;
+  HalfbandDecimator decimator = synth._decimator;
+  shaper_t shaper = synth._shaper;
+  chorus_t chorus = synth._chorus;
+  delay_t delay = synth._delay;
+#if REVERB_ENABLED
+  reverb_t reverb = synth._reverb;
+  bool room_active = synth._room._active;
+#endif
+  uint8_t shaper_factor = synth._distortion._factor;
+  bool ensemble_active = synth._ensemble._active;
+  bool echo_active = synth._echo._active;
+  LFO lfos[N_LFOS];
+  for (int i = 0; i < N_LFOS; i++) {
+    lfos[i] = synth._lfos[i];
+  }
+  float filter_mod[2] = {synth._filter_mod[0], synth._filter_mod[1]};
+  int32_t fm_index = synth._fm_index;
+  float output_gain = synth._output_gain;
+  uint32_t clock = synth._clock;
+
+  // Both oscillators on the interpolated wavetable read, the slowest single
+  // copy wave. Unison and FM are left to the measurement
+  synth._osc1.wave = wavetable;
+  synth._osc1.enabled = true;
+  synth._osc2.wave = wavetable;
+  synth._osc2.enabled = true;
+
+  // Every effect off
+  synth._shaper.drive = 0;
+  synth._chorus.mix = 0;
+  synth._delay.length = 0;
+#if REVERB_ENABLED
+  synth._reverb.wet = 0;
+#endif
+
+  // The effects run at the output rate, they are measured above the block
+  // at the current voice core rate
+  uint32_t base = _base[oversampling > 1 ? 1 : 0];
+
+  switch (_step) {
+  case CAL_VOICES_1X:
+  case CAL_VOICES_2X: {
+    int f = _step - CAL_VOICES_1X;
+    synth.set_oversampling(f == 0 ? 1 : QUALITY_OVERSAMPLING);
+    // Half the keys, so that the step fits in what is left of the period
+    _base[f] = bench_render_voices(0);
+    uint32_t cycles = bench_render_voices(MAX_KEYS / 2);
+    _voice[f] = cycles > _base[f] ? (cycles - _base[f]) / (MAX_KEYS / 2) : 0;
+    break;
+  }
+  case CAL_SHAPER_1X:
+  case CAL_SHAPER_2X:
+  case CAL_SHAPER_4X: {
+    // On silence, so that no line is left with audio
+    shaper_t on_shaper = shaper;
+    on_shaper.drive_enc = 16;
+    on_shaper.factor_enc = _step - CAL_SHAPER_1X;
+    shaper_update(on_shaper);
+    synth._shaper = on_shaper;
+    _shaper_cycles[on_shaper.factor_enc] = stage_cycles(base);
+    break;
+  }
+  case CAL_CHORUS:
+    synth._chorus.mix = 16384;
+    _chorus_cycles = stage_cycles(base);
+    break;
+  case CAL_DELAY:
+    // The cost does not depend on the delay time
+    synth._delay.length = DELAY_MAX_SAMPLES / 2;
+    _delay_cycles = stage_cycles(base);
+    break;
+  case CAL_REVERB:
+#if REVERB_ENABLED
+    synth._reverb.wet = 16384;
+    _reverb_cycles = stage_cycles(base);
+#endif
+    break;
+  }
+
+  synth.set_oversampling(oversampling);
+  synth._osc1 = osc1;
+  synth._osc2 = osc2;
+  synth._lpf = lpf;
+  synth._decimator = decimator;
+  synth._shaper = shaper;
+  synth._chorus = chorus;
+  synth._delay = delay;
+#if REVERB_ENABLED
+  synth._reverb = reverb;
+  synth._room._active = room_active;
+#endif
+  synth._distortion._factor = shaper_factor;
+  synth._ensemble._active = ensemble_active;
+  synth._echo._active = echo_active;
+  for (int i = 0; i < N_LFOS; i++) {
+    synth._lfos[i] = lfos[i];
+  }
+  synth._filter_mod[0] = filter_mod[0];
+  synth._filter_mod[1] = filter_mod[1];
+  synth._fm_index = fm_index;
+  synth._output_gain = output_gain;
+  synth._clock = clock;
+  synth._last_voice = nullptr;
+  synth._pitch.last_increment = 0.;
+
+  if (++_step < CAL_DONE) {
+    return;
+  }
+
+  printuln("[Governor] Budget %u cycles, block %u/%u, voice %u/%u (1x/2x)",
+           _budget, _base[0], _base[1], _voice[0], _voice[1]);
+  printuln("[Governor] Distortion %u/%u/%u (1x/2x/4x), chorus %u, delay %u, "
+           "reverb %u cycles",
+           _shaper_cycles[0], _shaper_cycles[1], _shaper_cycles[2],
+           _chorus_cycles, _delay_cycles, _reverb_cycles);
+
+  // Worst case, every effect on with the 4x distortion
+  uint32_t effects = _shaper_cycles[2] + _chorus_cycles + _delay_cycles +
+                     _reverb_cycles;
+  for (int f = 0; f < 2; f++) {
+    int fit = 0;
+    while (fit < MAX_KEYS &&
+           _base[f] + effects + (fit + 1) * _voice[f] <= _budget) {
+      fit++;
+    }
+    printuln("[Governor] Every effect on at %dx: %d voices fit",
+             f == 0 ? 1 : QUALITY_OVERSAMPLING, fit);
+  }
+
+  _predicted = predict(sounding(), synth._oversampling);
+#endif
+}
+
+uint32_t Governor::predict(int voices, uint8_t factor) {
+  int f = factor > 1 ? 1 : 0;
+  uint32_t cycles = _base[f] + voices * _voice[f];
+
+  if (synth._shaper.drive != 0) {
+    cycles += _shaper_cycles[synth._shaper.factor_enc];
+  }
+  if (synth._chorus.mix != 0) {
+    cycles += _chorus_cycles;
+  }
+  if (synth._delay.length != 0) {
+    cycles += _delay_cycles;
+  }
+#if REVERB_ENABLED
+  if (synth._reverb.wet != 0) {
+    cycles += _reverb_cycles;
+  }
+#endif
+
+  return cycles;
+}
+
+int Governor::sounding() {
+  int count = 0;
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state != IDLE) {
+      count++;
+    }
+  }
+  return count;
+}
+
+int Governor::playing() {
+  int count = 0;
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state != IDLE && !keys[j].envelope._stolen) {
+      count++;
+    }
+  }
+  return count;
+}
+
+Key *Governor::steal() {
+  // Released keys fade out first, so the lowest level is the least heard
+  Key *quietest = nullptr;
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state != IDLE && !keys[j].envelope._stolen &&
+        (quietest == nullptr ||
+         keys[j].envelope._level < quietest->envelope._level)) {
+      quietest = &keys[j];
+    }
+  }
+
+  // Cutting the voice would click, it is released quickly instead and
+  // freed by the synthesizer once silent
+  if (quietest != nullptr) {
+    quietest->state = RELEASED;
+    quietest->envelope.steal();
+  }
+  return quietest;
+}
+
+Key *Governor::allocate() {
+  if (playing() >= _max_voices) {
+    // Without a cap, the note is dropped as when every key is held
+    if (_max_voices == MAX_KEYS) {
+      return nullptr;
+    }
+
+    Key *key = steal();
+    printuln("[Governor] Polyphony capped at %d, stole note %d",
+             _max_voices, key->note);
+  }
+
+  // Under the cap a key is idle, unless stolen ones are still fading out
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state == IDLE) {
+      return &keys[j];
+    }
+  }
+  return nullptr;
+}
+
+void Governor::update(uint32_t cycles) {
+#if GOVERNOR_ENABLED
+  // Nothing to compare the render time with until calibrated
+  if (cycles == 0 || !calibrated()) {
+    return;
+  }
+
+  // The user switched the voice core back to 2x
+  if (synth._oversampling > 1) {
+    _oversampling_dropped = false;
+  }
+
+  // The measured block, corrected for the voices and effects switched on or
+  // off since it was rendered
+  int voices = sounding();
+  int32_t model = predict(voices, synth._oversampling);
+  int32_t estimate = (int32_t)cycles + model - (int32_t)_predicted;
+  if (estimate < 0) {
+    estimate = 0;
+  }
+
+  if (estimate > (int32_t)_budget) {
+    _calm = 0;
+
+    if (synth._oversampling > 1) {
+      synth.set_oversampling(1);
+      _oversampling_dropped = true;
+      int32_t lower = predict(voices, 1);
+      estimate += lower - model;
+      model = lower;
+      printuln("[Governor] Render at %u%% of the block, voice core dropped "
+               "to 1x",
+               (uint32_t)((uint64_t)cycles * 100 / _period));
+    }
+
+    // The stolen voices are silent within the next block
+    int held = playing();
+    while (estimate > (int32_t)_budget && held > 1) {
+      Key *key = steal();
+      held--;
+      _max_voices = held;
+      estimate -= _voice[0];
+      model -= _voice[0];
+      printuln("[Governor] Polyphony capped at %d, stole note %d", held,
+               key->note);
+    }
+
+    if (estimate > (int32_t)_budget && !_saturated) {
+      _saturated = true;
+      printuln("[Governor] Over budget, nothing left to degrade");
+    }
+
+    _predicted = model;
+    return;
+  }
+
+  _saturated = false;
+  _predicted = model;
+
+  if (estimate > (int32_t)_restore) {
+    _calm = 0;
+    return;
+  }
+  if (++_calm < GOVERNOR_HOLD_BLOCKS) {
+    return;
+  }
+  _calm = 0;
+
+  // Polyphony first, then the voice core rate. The estimates assume that
+  // every allowed voice sounds
+  int32_t more = predict(_max_voices + 1, synth._oversampling);
+  int32_t faster = predict(_max_voices, QUALITY_OVERSAMPLING);
+  if (_max_voices < MAX_KEYS && estimate + more - model <= (int32_t)_restore) {
+    _max_voices++;
+    printuln("[Governor] Polyphony restored to %d", _max_voices);
+  } else if (_oversampling_dropped &&
+             estimate + faster - model <= (int32_t)_restore) {
+    synth.set_oversampling(QUALITY_OVERSAMPLING);
+    _oversampling_dropped = false;
+    _predicted = predict(voices, QUALITY_OVERSAMPLING);
+    printuln("[Governor] Voice core restored to %dx", QUALITY_OVERSAMPLING);
+  }
+#endif
+}
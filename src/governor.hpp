@@ -0,0 +1,110 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "key.hpp"
+#include <stdint.h>
+
+// Set to 0 to let the render time overrun the block period
+#define GOVERNOR_ENABLED (1)
+
+/// @brief Render time allowed per block, in percent of the block period
+/// The rest of the superloop (USB, peripherals, codec write) runs in the
+/// remaining time
+const int GOVERNOR_BUDGET_PERCENT = 85;
+
+/// @brief Render time under which quality is restored, in percent of the
+/// block period. Restoring is only done when the estimate after the restore
+/// stays under it too, so that the governor does not oscillate
+const int GOVERNOR_RESTORE_PERCENT = 65;
+
+/// @brief Blocks in a row under the restore threshold before restoring one
+/// step of quality, 40 blocks = 2 s
+const int GOVERNOR_HOLD_BLOCKS = 40;
+
+/**
+ * Render time governor
+ *
+ * The cost of a block is modelled from a boot calibration: a fixed cost per
+ * block, a cost per voice at 1x and 2x and a cost per enabled effect. Before
+ * every block, the measured render time of the last block is corrected by the
+ * model for the voices and effects switched on or off since. When the
+ * estimate exceeds the budget, the governor drops the voice core to 1x, then
+ * steals the quietest voices and caps the polyphony. When the estimate stays
+ * low, the polyphony and then the voice core rate are restored one step at a
+ * time. Every decision is printed as a [Governor] line.
+ */
+class Governor {
+public:
+  uint32_t _period;            // cycles of a block period
+  uint32_t _budget;            // render cycles allowed per block
+  uint32_t _restore;           // render cycles under which quality returns
+  uint32_t _base[2];           // block without voices nor effects, 1x and 2x
+  uint32_t _voice[2];          // per voice, 1x and 2x
+  uint32_t _shaper_cycles[3];  // distortion at 1x, 2x and 4x oversampling
+  uint32_t _chorus_cycles;
+  uint32_t _delay_cycles;
+  uint32_t _reverb_cycles;
+  uint32_t _predicted;         // model of the last rendered block
+  uint8_t _max_voices;         // polyphony cap, MAX_KEYS when not capped
+  bool _oversampling_dropped;  // the voice core was dropped to 1x
+  bool _saturated;             // over budget with nothing left to degrade
+  int _calm;                   // blocks in a row under the restore threshold
+  int _step;                   // next calibration step
+
+  /// @brief Default constructor, uncalibrated and not degraded
+  Governor()
+      : _period{0}, _budget{0}, _restore{0}, _base{0, 0}, _voice{0, 0},
+        _shaper_cycles{0, 0, 0}, _chorus_cycles{0}, _delay_cycles{0},
+        _reverb_cycles{0}, _predicted{0}, _max_voices{MAX_KEYS},
+        _oversampling_dropped{false}, _saturated{false}, _calm{0}, _step{0} {}
+
+  /// @brief Measure the cost of the voices or of one effect
+  /// Calibration runs once audio has started, so that it does not delay the
+  /// first block: call it after every block until calibrated. A step renders
+  /// up to two blocks in the time left in the block period, only while no key
+  /// sounds, and an effect's step only while the effect is off. The
+  /// synthesizer parameters, filter, decimator, LFOs and clock and the state
+  /// of the effects are restored afterwards, a ringing tail goes on. The
+  /// governor leaves the quality alone until calibrated
+  void calibrate_step();
+
+  /// @brief Check whether every calibration step ran
+  /// @return true once the cost model is complete
+  bool calibrated() const;
+
+  /// @brief Model of the render time of a block
+  /// The effects enabled in the synthesizer parameters are included
+  /// @param voices number of sounding voices
+  /// @param factor voice core oversampling factor
+  /// @return the estimated cycles
+  uint32_t predict(int voices, uint8_t factor);
+
+  /// @brief Degrade or restore the quality before rendering the next block
+  /// @param cycles measured render time of the last block, 0 if none
+  void update(uint32_t cycles);
+
+  /// @brief Pick the key that plays a new note
+  /// Under the polyphony cap an idle key is returned. At the cap, the
+  /// quietest key is stolen and fades out, the note takes another idle key
+  /// @return the key, nullptr if the note is dropped
+  Key *allocate();
+
+  /// @brief Count the keys that are rendered
+  /// @return the number of keys that are not idle, stolen ones included
+  int sounding();
+
+private:
+  /// @brief Count the keys that hold a note, against the polyphony cap
+  /// @return the number of keys that are neither idle nor stolen
+  int playing();
+
+  /// @brief Fade out the quietest playing key
+  /// The envelope releases it in a few control periods, the key is idle once
+  /// it reaches 0, see ENVELOPE_STEAL_STEP
+  /// @return the stolen key
+  Key *steal();
+};
+
+extern Governor governor;
+
+#endif // GOVERNOR_H
@@ -0,0 +1,173 @@
+#include "i2c.h"
+#include "trace.h"
+#include "usb.h"
+#include <errno.h>
+#include <stdint.h>
+#include <zephyr/drivers/i2c.h>
+#include <zephyr/kernel.h>
+
+// Service thread, above the main thread like the codec thread: it only sets
+// the transfers up and sleeps while the interrupts send them
+#define I2C_STACK_SIZE 1024
+#define I2C_PRIORITY K_PRIO_COOP(CONFIG_NUM_COOP_PRIORITIES - 1)
+K_THREAD_STACK_DEFINE(i2c_stack, I2C_STACK_SIZE);
+static struct k_thread i2c_thread;
+
+/// @brief A queued transfer
+typedef struct i2c_request {
+  uint8_t devaddr;
+  uint8_t regaddr;
+  uint8_t regval;       // value to write
+  uint8_t *dst;         // read destination, nullptr for a write
+  volatile int *status; // read status
+} i2c_request_t;
+
+static const struct device *const i2c_dev = DEVICE_DT_GET(DT_NODELABEL(i2c1));
+
+// Ring of queued transfers, the service thread is the only reader
+static i2c_request_t queue[I2C_QUEUE_SIZE];
+static uint32_t queue_head = 0;
+static uint32_t queue_tail = 0;
+static struct k_spinlock queue_lock;
+// Set while the transfers taken from the queue are sent
+static volatile bool sending = false;
+K_SEM_DEFINE(i2c_queued, 0, 1);
+
+// First write error since the previous flush
+static atomic_t write_error = ATOMIC_INIT(0);
+// Failed write transfers since boot
+static atomic_t write_errors = ATOMIC_INIT(0);
+
+/// @brief Queue a transfer and wake the service thread
+static int enqueue(const i2c_request_t &request) {
+  k_spinlock_key_t key = k_spin_lock(&queue_lock);
+  if (queue_head - queue_tail == I2C_QUEUE_SIZE) {
+    k_spin_unlock(&queue_lock, key);
+    return -ENOMEM;
+  }
+  queue[queue_head % I2C_QUEUE_SIZE] = request;
+  queue_head++;
+  k_spin_unlock(&queue_lock, key);
+
+  k_sem_give(&i2c_queued);
+  return 0;
+}
+
+/// @brief Take the next batch from the queue: the writes to the device at
+/// the head of the queue, or a read
+/// @param batch where the batch is copied
+/// @return the number of transfers in the batch, 0 if the queue is empty
+static int dequeue(i2c_request_t *batch) {
+  k_spinlock_key_t key = k_spin_lock(&queue_lock);
+  int n = 0;
+  while (queue_tail != queue_head && n < I2C_BATCH_SIZE) {
+    const i2c_request_t &request = queue[queue_tail % I2C_QUEUE_SIZE];
+    if (n > 0 &&
+        (request.dst != nullptr || request.devaddr != batch[0].devaddr)) {
+      break;
+    }
+
+    batch[n++] = request;
+    queue_tail++;
+    if (request.dst != nullptr) {
+      break;
+    }
+  }
+  sending = n > 0;
+  k_spin_unlock(&queue_lock, key);
+  return n;
+}
+
+/// @brief Send the register writes of a batch in one transfer
+static int send_writes(const i2c_request_t *batch, int n) {
+  struct i2c_msg msgs[I2C_BATCH_SIZE];
+  uint8_t bufs[I2C_BATCH_SIZE][2];
+
+  for (int i = 0; i < n; i++) {
+    bufs[i][0] = batch[i].regaddr;
+    bufs[i][1] = batch[i].regval;
+    msgs[i].buf = bufs[i];
+    msgs[i].len = 2;
+    msgs[i].flags = I2C_MSG_WRITE;
+    if (i > 0) {
+      msgs[i].flags |= I2C_MSG_RESTART;
+    }
+    if (i == n - 1) {
+      msgs[i].flags |= I2C_MSG_STOP;
+    }
+  }
+
+  TRACE(TRACE_I2C_START, batch[0].devaddr, batch[0].regaddr, n);
+  int ret = i2c_transfer(i2c_dev, msgs, n, batch[0].devaddr);
+  TRACE(TRACE_I2C_END, batch[0].devaddr, 0, ret);
+  return ret;
+}
+
+/// @brief Service thread entry point
+static void i2c_entry(void *, void *, void *) {
+  i2c_request_t batch[I2C_BATCH_SIZE];
+
+  while (true) {
+    k_sem_take(&i2c_queued, K_FOREVER);
+
+    int n;
+    while ((n = dequeue(batch)) > 0) {
+      if (batch[0].dst != nullptr) {
+        TRACE(TRACE_I2C_START, batch[0].devaddr, batch[0].regaddr, 0);
+        int ret = i2c_write_read(i2c_dev, batch[0].devaddr, &batch[0].regaddr,
+                                 1, batch[0].dst, 1);
+        TRACE(TRACE_I2C_END, batch[0].devaddr, 0, ret);
+        *batch[0].status = ret;
+        continue;
+      }
+
+      int ret = send_writes(batch, n);
+      if (ret) {
+        printuln("Call `i2c_transfer` failed: %d, %d writes to 0x%x", ret, n,
+                 batch[0].devaddr);
+        atomic_cas(&write_error, 0, ret);
+        atomic_inc(&write_errors);
+      }
+    }
+  }
+}
+
+int initI2c() {
+  if (!device_is_ready(i2c_dev)) {
+    printuln("I2C device not ready");
+    return -ENODEV;
+  }
+
+  k_thread_create(&i2c_thread, i2c_stack, K_THREAD_STACK_SIZEOF(i2c_stack),
+                  i2c_entry, NULL, NULL, NULL, I2C_PRIORITY, 0, K_NO_WAIT);
+  return 0;
+}
+
+int i2cWrite(uint8_t devaddr, uint8_t regaddr, uint8_t regval) {
+  i2c_request_t request = {devaddr, regaddr, regval, nullptr, nullptr};
+  return enqueue(request);
+}
+
+int i2cRead(uint8_t devaddr, uint8_t regaddr, uint8_t *regval,
+            volatile int *status) {
+  *status = -EINPROGRESS;
+  i2c_request_t request = {devaddr, regaddr, 0, regval, status};
+  int ret = enqueue(request);
+  if (ret) {
+    *status = ret;
+  }
+  return ret;
+}
+
+uint32_t i2cWriteErrors() { return (uint32_t)atomic_get(&write_errors); }
+
+int i2cFlush(int timeout_ms) {
+  int64_t deadline = k_uptime_get() + timeout_ms;
+  while (queue_tail != queue_head || sending) {
+    if (k_uptime_get() >= deadline) {
+      return -EAGAIN;
+    }
+    k_msleep(1);
+  }
+  return atomic_set(&write_error, 0);
+}
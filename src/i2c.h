@@ -1,15 +1,54 @@
+#ifndef I2C_H
+#define I2C_H
+
 #include <stdint.h>
 
-/// @brief Read a byte from a device, syntactic sugar
-/// @param devaddr the peripheral device's address
-/// @param regaddr the device's register address
-/// @param regval the address where this function will write the read value
+/**
+ * Asynchronous I2C service. The transfers are queued and sent by a thread,
+ * the writes queued back to back to a device go out as one i2c_transfer()
+ * batch, one message per register joined by repeated starts
+ */
+
+/// @brief Queued transfers, a codec initialization fits
+#define I2C_QUEUE_SIZE 32
+
+/// @brief Largest number of register writes sent in one transfer
+#define I2C_BATCH_SIZE 24
+
+/// @brief Start the I2C service thread
+/// Call this function before queueing transfers
 /// @return 0 on success, -ERRNO otherwise
-int read(uint8_t devaddr, uint8_t regaddr, uint8_t *regval);
+int initI2c();
 
-/// @brief Write a byte from a device, syntactic sugar
+/// @brief Queue a register write, never blocks
 /// @param devaddr the peripheral device's address
 /// @param regaddr the device's register address
 /// @param regval the value to write to the device
-/// @return 0 on success, -ERRNO otherwise
-int write(uint8_t devaddr, uint8_t regaddr, uint8_t regval);
\ No newline at end of file
+/// @return 0 on success, -ENOMEM if the queue is full
+int i2cWrite(uint8_t devaddr, uint8_t regaddr, uint8_t regval);
+
+/// @brief Queue a register read, never blocks
+/// The status is -EINPROGRESS until the value is read, then 0 on success or
+/// -ERRNO
+/// @param devaddr the peripheral device's address
+/// @param regaddr the device's register address
+/// @param regval where the service will write the read value
+/// @param status the status of the read
+/// @return 0 on success, -ENOMEM if the queue is full
+int i2cRead(uint8_t devaddr, uint8_t regaddr, uint8_t *regval,
+            volatile int *status);
+
+/// @brief Number of write transfers that failed since boot
+/// The writes are sent after they are queued: a change of the count means
+/// that any register write queued before it may be lost
+/// @return the failed write transfers
+uint32_t i2cWriteErrors();
+
+/// @brief Wait until the queued transfers are sent
+/// Not for the audio loop, it sleeps meanwhile
+/// @param timeout_ms longest wait in milliseconds
+/// @return the first write error since the previous flush, 0 if none,
+/// -EAGAIN on timeout
+int i2cFlush(int timeout_ms);
+
+#endif // I2C_H
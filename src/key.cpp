@@ -1,89 +1,142 @@
+#include "dsp.h"
+
 #include "key.hpp"
+#include "memmap.h"
+#include "notes.hpp"
+
+DSP_STATE Key keys[MAX_KEYS];
 
-Key keys[MAX_KEYS];
+DSP_TABLE constexpr note_table_t NOTE_TABLE = make_note_table();
+
+static_assert(NOTE_TABLE.increment[NOTE_A4] == 440.f * HZ_TO_INCREMENT,
+              "A4 must be 440 Hz");
 
 /*
- *  s d   g h j
- * z x c v b n m ,
- * | | | | | | | |
- * C D E F G A B C
+ *  w e   t y u   o p
+ * a s d f g h j k l ;
+ * | | | | | | | | | |
+ * C D E F G A B C D E
+ *
+ * z/x shift the keyboard one octave down/up
  */
-key_t Key::char_to_key(char c) {
+static constexpr uint8_t default_keymap_entry(int c) {
   switch (c) {
-  case ';':
-    return E4;
-  case 'p':
-    return Dh4;
-  case 'l':
-    return D4;
-  case 'o':
-    return Ch4;
-  case 'k':
-    return C4;
-  case 'j':
-    return B4;
-  case 'u':
-    return Bb4;
-  case 'h':
-    return A4;
-  case 'y':
-    return Ab3;
-  case 'g':
-    return G3;
-  case 't':
-    return Fh3;
-  case 'f':
-    return F3;
-  case 'd':
-    return E3;
-  case 'e':
-    return Dh3;
-  case 's':
-    return D3;
-  case 'w':
-    return Ch3;
   case 'a':
-    return C3;
+    return 0;
+  case 'w':
+    return 1;
+  case 's':
+    return 2;
+  case 'e':
+    return 3;
+  case 'd':
+    return 4;
+  case 'f':
+    return 5;
+  case 't':
+    return 6;
+  case 'g':
+    return 7;
+  case 'y':
+    return 8;
+  case 'h':
+    return 9;
+  case 'u':
+    return 10;
+  case 'j':
+    return 11;
+  case 'k':
+    return 12;
+  case 'o':
+    return 13;
+  case 'l':
+    return 14;
+  case 'p':
+    return 15;
+  case ';':
+    return 16;
+  case 'z':
+    return KEY_OCTAVE_DOWN;
+  case 'x':
+    return KEY_OCTAVE_UP;
   default:
-    return A3;
+    return KEY_UNMAPPED;
+  }
+}
+
+static constexpr keymap_t make_default_keymap() {
+  keymap_t map{};
+
+  for (int c = 0; c < 256; c++) {
+    map.entry[c] = default_keymap_entry(c);
   }
+
+  return map;
 }
 
-float Key::get_freq() {
-  switch (key) {
-  case A3:
-    return 200.0;
-  case Bb3:
-    return 233.08;
-  case B3:
-    return 246.94;
-  case C3:
-    return 261.626;
-  case Ch3:
-    return 277.183;
-  case D3:
-    return 293.665;
-  case Dh3:
-    return 311.127;
-  case E3:
-    return 329.628;
-  case F3:
-    return 349.228;
-  case Fh3:
-    return 369.994;
-  case G3:
-    return 391.995;
-  case Ab3:
-    return 415.305;
-  case A4:
-    return 440.000;
-  case Bb4:
-    return 466.164;
-  case B4:
-    return 493.883;
-  case C4:
-    return 523.251;
+keymap_t keymap = make_default_keymap();
+int8_t keyboard_octave = 0;
+
+// Remap command parser state
+static enum { REMAP_IDLE, REMAP_CHAR, REMAP_ENTRY } remap_state = REMAP_IDLE;
+static uint8_t remap_char;
+
+bool Key::char_to_note(char c, uint8_t &note) {
+  uint8_t entry = keymap.entry[(uint8_t)c];
+
+  switch (entry) {
+  case KEY_UNMAPPED:
+    return false;
+  case KEY_OCTAVE_DOWN:
+    shift_octave(-1);
+    return false;
+  case KEY_OCTAVE_UP:
+    shift_octave(1);
+    return false;
   default:
-    return 0.;
+    break;
   }
-}
\ No newline at end of file
+
+  int n = KEYBOARD_BASE_NOTE + 12 * keyboard_octave + entry;
+  if (n < 0 || n >= N_NOTES) {
+    return false;
+  }
+
+  note = n;
+  return true;
+}
+
+void Key::shift_octave(int octaves) {
+  int octave = keyboard_octave + octaves;
+
+  if (octave < MIN_OCTAVE_SHIFT) {
+    octave = MIN_OCTAVE_SHIFT;
+  } else if (octave > MAX_OCTAVE_SHIFT) {
+    octave = MAX_OCTAVE_SHIFT;
+  }
+
+  keyboard_octave = octave;
+}
+
+bool Key::feed_remap(uint8_t byte) {
+  switch (remap_state) {
+  case REMAP_IDLE:
+    if (byte != KEYMAP_REMAP_START) {
+      return false;
+    }
+    remap_state = REMAP_CHAR;
+    break;
+  case REMAP_CHAR:
+    remap_char = byte;
+    remap_state = REMAP_ENTRY;
+    break;
+  case REMAP_ENTRY:
+    keymap.entry[remap_char] = byte;
+    remap_state = REMAP_IDLE;
+    break;
+  }
+
+  return true;
+}
+
+bool Key::remapping() { return remap_state != REMAP_IDLE; }
@@ -1,31 +1,31 @@
 #ifndef __KEY_H_H_
 #define __KEY_H_H_
 
+#include "envelope.hpp"
+#include "unison.hpp"
 #include <stdint.h>
 #include <zephyr/kernel.h>
 
-typedef enum {
-  A3,
-  Bb3,
-  B3,
-  C3,
-  Ch3,
-  D3,
-  Dh3,
-  E3,
-  F3,
-  Fh3,
-  G3,
-  Ab3,
-  A4,
-  Bb4,
-  B4,
-  C4,
-  Ch4,
-  D4,
-  Dh4,
-  E4,
-} key_t;
+/// @brief MIDI note played by the first entry of the keyboard map
+const uint8_t KEYBOARD_BASE_NOTE = 60;
+
+/**
+ * Keyboard map entries: semitone offset from KEYBOARD_BASE_NOTE, or one of
+ * the following commands
+ */
+const uint8_t KEY_UNMAPPED = 0xFF;
+const uint8_t KEY_OCTAVE_DOWN = 0xFE;
+const uint8_t KEY_OCTAVE_UP = 0xFD;
+
+/// @brief Octave shift limits of the keyboard
+const int8_t MIN_OCTAVE_SHIFT = -4;
+const int8_t MAX_OCTAVE_SHIFT = 4;
+
+/**
+ * Remap protocol, over the CDC port:
+ *   0x02 (STX), character, keyboard map entry
+ */
+const uint8_t KEYMAP_REMAP_START = 0x02;
 
 /// @brief The state of a key
 typedef enum { IDLE, PRESSED, RELEASED } key_state_t;
@@ -33,33 +33,70 @@ typedef enum { IDLE, PRESSED, RELEASED } key_state_t;
 /// @brief Maximum number of keys. Space allocated at compile time.
 const uint8_t MAX_KEYS = 4;
 
+/// @brief Time a key stays pressed after its last character, the terminal
+/// sends no key release. A whole number of blocks
+const uint32_t KEY_HOLD_MS = 500;
+
 class Key {
 public:
   /// @brief Key constructor
   Key()
-      : state{IDLE}, key{A3}, hold_time{sys_timepoint_calc(K_FOREVER)},
-        release_time{sys_timepoint_calc(K_FOREVER)}, elapsed_hold{0.0},
-        elapsed_release{0.0}, phase1{0}, phase2{0} {}
+      : state{IDLE}, note{KEYBOARD_BASE_NOTE}, increment{0.}, increment1{0},
+        increment2{0}, increment_step1{0}, increment_step2{0}, phase1{0},
+        phase2{0}, gain1{0.}, gain2{0.}, gain_step1{0.}, gain_step2{0.},
+        freq_mod1{0.}, freq_mod2{0.}, retune{true}, hold_until{0} {}
 
-  /// @brief Generate key_t struct from keyboard input
+  /// @brief Translate keyboard input to a MIDI note through the keyboard map
+  /// Octave shift commands are applied here
   /// @param c the keyboard input
-  /// @return keyboard key
-  static key_t char_to_key(char c);
+  /// @param note the note to play, only set when true is returned
+  /// @return true if the input plays a note
+  static bool char_to_note(char c, uint8_t &note);
 
-  /// @brief Get the frequency of this specific key
-  /// @return this key's frequency
-  float get_freq();
+  /// @brief Shift the keyboard by a number of octaves
+  /// @param octaves octaves to shift by, clamped to the octave shift limits
+  static void shift_octave(int octaves);
+
+  /// @brief Feed one byte received from the host to the remap parser
+  /// @param byte the received byte
+  /// @return true if the byte belongs to a remap command, false otherwise
+  static bool feed_remap(uint8_t byte);
+
+  /// @brief Check whether a remap command is being received
+  /// @return true if the parser is in the middle of a command
+  static bool remapping();
 
   key_state_t state;
-  key_t key;
-  uint16_t phase1;
-  uint16_t phase2;
-  k_timepoint_t hold_time;
-  k_timepoint_t release_time;
-  float elapsed_hold;
-  float elapsed_release;
+  uint8_t note;        // MIDI note number
+  float increment;     // note phase increment, gliding towards the note's
+  uint32_t increment1; // oscillator 1 phase increment, ramped like the gain
+  uint32_t increment2; // oscillator 2 phase increment
+  int32_t increment_step1; // increment change per sample, set at control rate
+  int32_t increment_step2;
+  uint32_t phase1;     // 16.16 phases, the top 16 bits index the waveforms
+  uint32_t phase2;
+  float gain1;      // oscillator 1 gain, ramped across the control period
+  float gain2;      // oscillator 2 gain
+  float gain_step1; // gain change per sample, set at control rate
+  float gain_step2;
+  float freq_mod1; // pitch modulation the increments were computed with
+  float freq_mod2;
+  bool retune; // increments to recompute at the next control tick
+  Envelope envelope;
+  Unison unison1;
+  Unison unison2;
+  uint32_t hold_until; // sample clock at which a pressed key is released
 };
 
+/// @brief Keyboard map, indexed by the received character
+typedef struct keymap {
+  uint8_t entry[256];
+} keymap_t;
+
+extern keymap_t keymap;
+/// @brief Current keyboard octave shift
+extern int8_t keyboard_octave;
+
 extern Key keys[MAX_KEYS];
 
 #endif // __KEY_H__
\ No newline at end of file
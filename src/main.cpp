@@ -5,74 +5,140 @@
  */
 
 #include "Switch.hpp"
+#include "analyzer.h"
 #include "audio.h"
+#include "bench.h"
+#include "governor.hpp"
+#include "i2c.h"
 #include "key.hpp"
 #include "leds.h"
+#include "memmap.h"
 #include "peripherals.h"
+#include "preset.hpp"
+#include "regression.h"
 #include "synth.hpp"
+#include "trace.h"
 #include "usb.h"
+#include "wavetable.hpp"
 #include <math.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 
-Synthesizer synth;
+DSP_STATE Synthesizer synth;
+
+// Render time of one audio block
+static bench_t render_bench = {"render"};
+
+/// @brief Feed one byte received from the host to the message parsers
+/// Wavetable uploads, keyboard remaps, modulation routes and presets share the
+/// port with the keyboard, an unfinished message takes all the following bytes
+/// @param byte the received byte
+/// @return true if the byte belongs to a message, false if it is a key
+static bool feed_message(uint8_t byte) {
+  if (wt_bank.uploading()) {
+    return wt_bank.feed(byte);
+  }
+  if (Key::remapping()) {
+    return Key::feed_remap(byte);
+  }
+  if (synth._matrix.receiving()) {
+    return synth._matrix.feed(byte);
+  }
+  if (preset_receiving()) {
+    return preset_feed(byte);
+  }
+
+  return wt_bank.feed(byte) || Key::feed_remap(byte) ||
+         synth._matrix.feed(byte) || preset_feed(byte) || trace_feed(byte);
+}
 
 // Function that checks key presses
 static void check_keyboard() {
   char character;
   while (usbRead(&character, 1)) {
-    auto key = Key::char_to_key(character);
+    if (feed_message(character)) {
+      continue;
+    }
+
+    uint8_t note;
+    if (!Key::char_to_note(character, note)) {
+      continue;
+    }
+
     bool key_pressed = false;
     for (int i = 0; i < MAX_KEYS; i++) {
-      if (key == keys[i].key && keys[i].state != IDLE) {
-        keys[i].state = PRESSED;
-        keys[i].hold_time = sys_timepoint_calc(K_MSEC(500));
-        keys[i].release_time = sys_timepoint_calc(K_MSEC(500));
+      // A stolen key fades out, the note takes a new one
+      if (note == keys[i].note && keys[i].state != IDLE &&
+          !keys[i].envelope._stolen) {
+        synth.hold(keys[i], KEY_HOLD_MS);
         key_pressed = true;
       }
     }
     // The second loop is necessary to avoid selecting an IDLE key when a
     // PRESSED or RELEASED key is located further away on the array
     if (!key_pressed) {
-      for (int i = 0; i < MAX_KEYS; i++) {
-        if (keys[i].state == IDLE) {
-          keys[i].key = key;
-          keys[i].state = PRESSED;
-          keys[i].hold_time = sys_timepoint_calc(K_MSEC(500));
-          keys[i].release_time = sys_timepoint_calc(K_MSEC(500));
-          keys[i].phase1 = 0;
-          keys[i].phase2 = 0;
-          break;
-        }
+      // An idle key, or a stolen one while the polyphony is capped
+      Key *key = governor.allocate();
+      if (key != nullptr) {
+        TRACE(TRACE_VOICE, note, key - keys, 0);
+        synth.start_voice(*key, note);
+        synth.hold(*key, KEY_HOLD_MS);
       }
     }
   }
 }
 
 int main(void) {
+  boot_phase("start");
+
+  // The output is buffered until a host opens the port, the synthesizer does
+  // not wait for it
   initUsb();
-  waitForUsb();
+  boot_phase("usb");
 
   printuln("== Initializing... ==");
 
   init_leds();
-  initAudio();
+  // The codec and port expander transfers are queued to the I2C service
+  initI2c();
+  // The codec is configured while the rest is initialized
+  initAudioAsync();
   init_peripherals();
+  boot_phase("peripherals");
 
   synth.initialize();
+  preset_init();
+  boot_phase("synth");
+
+  waitForAudio();
+  boot_phase("codec");
+  // The codec volume is a fixed range, the master volume encoder sets a
+  // digital gain
+  setVolume(MASTER_CODEC_VOLUME);
 
   // Buffer for writing to audio driver
   void *mem_block = allocBlock();
 
   printuln("== Finished initialization ==");
+  memmap_report();
+#if BENCH_KERNELS
+  bench_kernels();
+#endif
+#if REGRESSION_CHECK
+  regression_check();
+#endif
+  analyzer_init();
 
   int64_t time = k_uptime_get();
   int state = 0;
+  bool first_block = true;
+  uint32_t block_count = 0;
 
   while (1) {
     // Run the superloop slightly faster than once every 50 ms
     if (k_uptime_get() - time > BLOCK_GEN_PERIOD_MS - 1) {
       time = k_uptime_get();
+      usbPoll();
 
       if (state) {
         set_led(&status_led0);
@@ -91,16 +157,52 @@ int main(void) {
       check_keyboard();
       reset_led(&debug_led1);
 
+      // A loaded preset is applied between two blocks
+      preset_apply();
+
+      // Degrade or restore the quality before the block can overrun
+      governor.update(render_bench.last);
+
       // Make synth sound
       set_led(&debug_led2);
+      TRACE(TRACE_RENDER_START, governor.sounding(), 0, block_count);
+      bench_start(&render_bench);
       synth.makesynth((uint8_t *)mem_block);
+      bench_stop(&render_bench);
+      TRACE(TRACE_RENDER_END, 0, 0, block_count);
+      block_count++;
       reset_led(&debug_led2);
 
+      analyzer_capture((const int16_t *)mem_block);
+
       // Write audio block
       set_led(&debug_led3);
       writeBlock(mem_block);
       reset_led(&debug_led3);
+
+      // A trace dump is written a few records per block
+      trace_poll();
+
+      // From here on, a key press is heard within one block
+      if (first_block) {
+        boot_phase("first block");
+        boot_report();
+        first_block = false;
+      }
+
+      // The governor measures the render costs in the time left by the
+      // first blocks, a key press comes first
+      if (!governor.calibrated()) {
+        governor.calibrate_step();
+      }
+
+      if (render_bench.count == BENCH_REPORT_PERIOD) {
+        bench_report(&render_bench);
+      }
     }
+
+    // Leave the CPU to the lower priority threads until the next block
+    k_sleep(K_TIMEOUT_ABS_MS(time + BLOCK_GEN_PERIOD_MS));
   }
 
   return 0;
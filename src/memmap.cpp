@@ -0,0 +1,68 @@
+#include "memmap.h"
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/linker/linker-defs.h>
+
+#include "chorus.hpp"
+#include "delay.hpp"
+#include "key.hpp"
+#include "notes.hpp"
+#include "reverb.hpp"
+#include "sine.hpp"
+#include "synth.hpp"
+#include "waveshaper.hpp"
+#include "usb.h"
+
+// STM32F407 memory map, RM0090 section 2.3
+static const uintptr_t CCM_BASE = 0x10000000;
+static const uintptr_t CCM_END = 0x10010000;
+static const uintptr_t SRAM_BASE = 0x20000000;
+static const uintptr_t SRAM_END = 0x20020000;
+
+/// @brief Name of the memory region an address belongs to
+static const char *region_name(const void *addr) {
+  uintptr_t a = (uintptr_t)addr;
+
+  if (a >= CCM_BASE && a < CCM_END) {
+    return "CCM";
+  } else if (a >= SRAM_BASE && a < SRAM_END) {
+    return "SRAM";
+  }
+  return "FLASH";
+}
+
+static void report_object(const char *name, const void *addr, size_t size) {
+  printuln("[Memmap] %-18s %p %6u B  %s", name, addr, (unsigned int)size,
+           region_name(addr));
+}
+
+void memmap_report() {
+  printuln("[Memmap] DSP placement %s",
+           DSP_PLACEMENT ? "enabled" : "disabled");
+
+#if DT_NODE_HAS_STATUS(DT_CHOSEN(zephyr_ccm), okay)
+  printuln("[Memmap] .ccm_data %u B, .ccm_bss %u B",
+           (unsigned int)(__ccm_data_end - __ccm_data_start),
+           (unsigned int)(__ccm_bss_end - __ccm_bss_start));
+#endif
+#if defined(CONFIG_ARCH_HAS_RAMFUNC_SUPPORT)
+  printuln("[Memmap] .ramfunc %u B",
+           (unsigned int)(__ramfunc_end - __ramfunc_start));
+#endif
+
+  report_object("SINE_LUT", SINE_LUT, sizeof(SINE_LUT));
+  report_object("NOTE_TABLE", &NOTE_TABLE, sizeof(NOTE_TABLE));
+  report_object("SHIFT_FREQUENCIES", SHIFT_FREQUENCIES,
+                sizeof(SHIFT_FREQUENCIES));
+  report_object("LFO_FREQUENCIES", LFO_FREQUENCIES, sizeof(LFO_FREQUENCIES));
+  report_object("LFO_AMPLITUDES", LFO_AMPLITUDES, sizeof(LFO_AMPLITUDES));
+  report_object("keys", keys, sizeof(keys));
+  report_object("synth", &synth, sizeof(synth));
+  report_object("SHAPER_LUT", SHAPER_LUT, sizeof(SHAPER_LUT));
+  report_object("chorus_line", chorus_line, sizeof(chorus_line));
+  report_object("delay_line", delay_line, sizeof(delay_line));
+#if REVERB_ENABLED
+  report_object("reverb_lines", reverb_lines, sizeof(reverb_lines));
+#endif
+}
@@ -0,0 +1,46 @@
+#ifndef MEMMAP_H
+#define MEMMAP_H
+
+#include <zephyr/devicetree.h>
+#include <zephyr/linker/section_tags.h>
+
+/**
+ * Memory placement of the hot DSP tables, state and code
+ *
+ * The STM32F407 has 64 KB of core-coupled memory (CCM) on the D-bus with zero
+ * wait states, 128 KB of SRAM and a flash running with 5 wait states at
+ * 168 MHz. Tables and voice state read every sample go to CCM, the render
+ * kernels are copied to SRAM at boot. Instruction fetches then use the S-bus
+ * while data loads use the D-bus, so they never contend.
+ *
+ * CCM is not reachable by the DMA: never place audio buffers (the I2S memory
+ * slab) or anything handed to a driver in it.
+ */
+
+/// @brief Set to 0 to build everything in the default sections, e.g. to
+/// compare the render benchmark before and after placement
+#define DSP_PLACEMENT 1
+
+#if DSP_PLACEMENT && DT_NODE_HAS_STATUS(DT_CHOSEN(zephyr_ccm), okay)
+// Read-only lookup tables, copied from flash to CCM at boot
+#define DSP_TABLE __ccm_data_section
+// Zero-initialized voice, filter and LFO state
+#define DSP_STATE __ccm_bss_section
+#else
+#define DSP_TABLE
+#define DSP_STATE
+#endif
+
+#if DSP_PLACEMENT && defined(CONFIG_ARCH_HAS_RAMFUNC_SUPPORT)
+// Render kernels executed from SRAM. Note: implies noinline, only use it on
+// functions that are called at most once per sample per voice
+#define DSP_CODE __ramfunc
+#else
+#define DSP_CODE
+#endif
+
+/// @brief Print where the DSP sections and hot objects landed
+/// Call it once during initialization, after the USB port is open
+void memmap_report();
+
+#endif // MEMMAP_H
@@ -0,0 +1,104 @@
+#include "dsp.h"
+
+#include "modmatrix.hpp"
+
+#include <string.h>
+
+#include "usb.h"
+
+// Full range of every destination, reached by a route of depth MOD_DEPTH_ONE
+// from a full-scale source
+static const float MOD_DEST_RANGE[N_MOD_DESTS] = {
+    2.,   // MOD_OSC1_FREQ, semitones
+    2.,   // MOD_OSC2_FREQ
+    1.,   // MOD_OSC1_AMP, relative gain
+    1.,   // MOD_OSC2_AMP
+    2.,   // MOD_LPF_CUTOFF, octaves
+    512., // MOD_OSC1_WAVE, two frames
+    512., // MOD_OSC2_WAVE
+    2.,   // MOD_LPF_RESONANCE, octaves of Q
+};
+
+ModMatrix::ModMatrix()
+    : _n_shared{0}, _n_routes{0}, _lfo_mask{0}, _dirty{true},
+      _parser{ROUTE_IDLE} {
+  memset(_depth, 0, sizeof(_depth));
+
+  // Keep the behaviour of the LFO target switches: every LFO modulates its
+  // own target, and is active as soon as its level is not 0
+  for (int i = 0; i < N_LFOS; i++) {
+    _depth[MOD_SRC_LFO + i][i] = MOD_DEPTH_ONE;
+  }
+}
+
+void ModMatrix::set_depth(int source, int dest, int8_t depth) {
+  _depth[source][dest] = depth;
+  _dirty = true;
+}
+
+void ModMatrix::compile(const LFO lfos[N_LFOS]) {
+  _n_routes = 0;
+  _lfo_mask = 0;
+
+  // Shared sources first, so that they are walked once per tick
+  for (int source = 0; source < N_MOD_SOURCES; source++) {
+    if (source == MOD_SRC_VOICE) {
+      _n_shared = _n_routes;
+    }
+    if (source < MOD_SRC_VOICE &&
+        lfos[source - MOD_SRC_LFO]._amplitude == 0.f) {
+      continue;
+    }
+
+    for (int dest = 0; dest < N_MOD_DESTS; dest++) {
+      if (_depth[source][dest] == 0) {
+        continue;
+      }
+
+      mod_route_t &route = _routes[_n_routes++];
+      route.source = source;
+      route.dest = dest;
+      route.scale = _depth[source][dest] * MOD_DEST_RANGE[dest] / MOD_DEPTH_ONE;
+
+      if (source < MOD_SRC_VOICE) {
+        _lfo_mask |= 1 << (source - MOD_SRC_LFO);
+      }
+    }
+  }
+
+  _dirty = false;
+}
+
+bool ModMatrix::feed(uint8_t byte) {
+  switch (_parser) {
+  case ROUTE_IDLE:
+    if (byte != MOD_ROUTE_START) {
+      return false;
+    }
+    _parser = ROUTE_SOURCE;
+    break;
+  case ROUTE_SOURCE:
+    _route_source = byte;
+    _parser = ROUTE_DEST;
+    break;
+  case ROUTE_DEST:
+    _route_dest = byte;
+    _parser = ROUTE_DEPTH;
+    break;
+  case ROUTE_DEPTH:
+    _parser = ROUTE_IDLE;
+
+    if (_route_source >= N_MOD_SOURCES || _route_dest >= N_MOD_DESTS) {
+      printuln("[Mod Matrix] Route %d -> %d dropped: out of range",
+               _route_source, _route_dest);
+      break;
+    }
+
+    set_depth(_route_source, _route_dest, (int8_t)byte);
+    printuln("[Mod Matrix] Route %d -> %d: depth %d/%d", _route_source,
+             _route_dest, (int8_t)byte, MOD_DEPTH_ONE);
+    break;
+  }
+
+  return true;
+}
@@ -0,0 +1,123 @@
+#ifndef MODMATRIX_H
+#define MODMATRIX_H
+
+#include "lfo.hpp"
+#include <stdint.h>
+
+/**
+ * Modulation sources. LFO sources are shared by all voices, the others are
+ * evaluated per voice
+ */
+typedef enum mod_source {
+  MOD_SRC_LFO = 0, // one source per LFO, MOD_SRC_LFO + LFO index
+  MOD_SRC_ENVELOPE = N_LFOS,
+  MOD_SRC_VELOCITY,
+  MOD_SRC_KEY
+} mod_source_t;
+
+/// @brief Number of modulation sources
+const int N_MOD_SOURCES = N_LFOS + 3;
+/// @brief First per-voice modulation source
+const int MOD_SRC_VOICE = MOD_SRC_ENVELOPE;
+
+/**
+ * Modulation destinations. The first ones match lfo_target_t so that LFO n
+ * is routed to destination n by default
+ */
+typedef enum mod_dest {
+  MOD_OSC1_FREQ = OSC1_FREQ, // semitones
+  MOD_OSC2_FREQ = OSC2_FREQ,
+  MOD_OSC1_AMP = OSC1_AMP, // relative gain
+  MOD_OSC2_AMP = OSC2_AMP,
+  MOD_LPF_CUTOFF = LPF_CUTOFF, // octaves
+  MOD_OSC1_WAVE = OSC1_WAVE,   // wavetable morph positions
+  MOD_OSC2_WAVE = OSC2_WAVE,
+  MOD_LPF_RESONANCE // octaves of Q
+} mod_dest_t;
+
+/// @brief Number of modulation destinations
+const int N_MOD_DESTS = 8;
+
+/// @brief Route depths are signed Q4, 16 = full range of the destination
+const int MOD_DEPTH_ONE = 16;
+
+/**
+ * Route protocol, over the CDC port:
+ *   0x03 (ETX), source, destination, depth (int8, Q4)
+ * A depth of 0 removes the route.
+ */
+const uint8_t MOD_ROUTE_START = 0x03;
+
+/// @brief A compiled route: destination += source * scale
+typedef struct mod_route {
+  uint8_t source;
+  uint8_t dest;
+  float scale; // depth times the destination range
+} mod_route_t;
+
+/// @brief Sparse modulation matrix
+/// Depths are kept for every source/destination pair, but only the active
+/// routes are compiled into a compact list walked at control rate
+class ModMatrix {
+public:
+  int8_t _depth[N_MOD_SOURCES][N_MOD_DESTS];
+
+  // Active routes, the ones from shared sources first
+  mod_route_t _routes[N_MOD_SOURCES * N_MOD_DESTS];
+  int _n_shared;
+  int _n_routes;
+  uint8_t _lfo_mask; // LFOs used by an active route
+  bool _dirty;       // depths or LFO levels changed since the last compile
+
+  /// @brief Default constructor, LFO n modulates destination n
+  ModMatrix();
+
+  /// @brief Set the depth of a route, recompiled on the next control tick
+  /// @param source the modulation source
+  /// @param dest the modulation destination
+  /// @param depth the depth, Q4
+  void set_depth(int source, int dest, int8_t depth);
+
+  /// @brief Rebuild the active route list
+  /// LFO routes are only active while the LFO level is not 0
+  /// @param lfos the LFOs
+  void compile(const LFO lfos[N_LFOS]);
+
+  /// @brief Add the shared routes to the destinations
+  /// @param sources source values, only the shared ones are read
+  /// @param mod destination values
+  void apply_shared(const float sources[N_MOD_SOURCES],
+                    float mod[N_MOD_DESTS]) const {
+    for (int i = 0; i < _n_shared; i++) {
+      mod[_routes[i].dest] += sources[_routes[i].source] * _routes[i].scale;
+    }
+  }
+
+  /// @brief Add the per-voice routes to the destinations
+  /// @param sources source values, only the per-voice ones are read
+  /// @param mod destination values
+  void apply_voice(const float sources[N_MOD_SOURCES],
+                   float mod[N_MOD_DESTS]) const {
+    for (int i = _n_shared; i < _n_routes; i++) {
+      mod[_routes[i].dest] += sources[_routes[i].source] * _routes[i].scale;
+    }
+  }
+
+  /// @brief Feed one byte received from the host to the route parser
+  /// @param byte the received byte
+  /// @return true if the byte belongs to a route command, false otherwise
+  bool feed(uint8_t byte);
+
+  /// @brief Check whether a route command is being received
+  /// @return true if the parser is in the middle of a command
+  bool receiving() const { return _parser != ROUTE_IDLE; }
+
+private:
+  typedef enum { ROUTE_IDLE, ROUTE_SOURCE, ROUTE_DEST, ROUTE_DEPTH } parser_t;
+
+  parser_t _parser;
+  uint8_t _route_source;
+  uint8_t _route_dest;
+};
+
+#endif // MODMATRIX_H
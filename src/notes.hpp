@@ -0,0 +1,55 @@
+#ifndef NOTES_H
+#define NOTES_H
+
+#include "audio.h"
+#include <stdint.h>
+
+/// @brief Number of MIDI notes
+const int N_NOTES = 128;
+/// @brief MIDI note number of A4 (440 Hz)
+const int NOTE_A4 = 69;
+
+/// @brief 32-bit phase increment per sample for a 1 Hz tone
+/// Phases are 16.16 fixed point: the top 16 bits index the waveforms
+constexpr float HZ_TO_INCREMENT = 4294967296.f / SAMPLE_FREQUENCY;
+
+/// @brief Largest phase increment, the Nyquist frequency
+constexpr float MAX_INCREMENT = 2147483647.f;
+
+// Equal-tempered semitone ratios 2^(k/12), k = 0..11
+constexpr float SEMITONE_RATIOS[12] = {
+    1.000000, 1.059463, 1.122462, 1.189207, 1.259921, 1.334840,
+    1.414214, 1.498307, 1.587401, 1.681793, 1.781797, 1.887749};
+
+/// @brief Phase increment of every MIDI note
+typedef struct note_table {
+  float increment[N_NOTES];
+} note_table_t;
+
+/// @brief Generate the note increments at compile time
+constexpr note_table_t make_note_table() {
+  note_table_t table{};
+
+  for (int note = 0; note < N_NOTES; note++) {
+    // Semitone and octave relative to A4, kept non-negative for the modulo
+    int relative = note - NOTE_A4 + 12 * 6;
+    int octave = relative / 12 - 6;
+    float freq = 440.f * SEMITONE_RATIOS[relative % 12];
+
+    for (int i = 0; i < octave; i++) {
+      freq *= 2.f;
+    }
+    for (int i = 0; i > octave; i--) {
+      freq /= 2.f;
+    }
+
+    table.increment[note] = freq * HZ_TO_INCREMENT;
+  }
+
+  return table;
+}
+
+/// @brief Phase increment of every MIDI note, defined in key.cpp
+extern const note_table_t NOTE_TABLE;
+
+#endif // NOTES_H
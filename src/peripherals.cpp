@@ -2,7 +2,9 @@
 
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/drivers/i2c.h>
+#include <zephyr/kernel.h>
 
+#include "i2c.h"
 #include "usb.h"
 
 // Port expanders registers addresses:
@@ -41,7 +43,21 @@ const struct gpio_dt_spec sw3_up = GPIO_DT_SPEC_GET(DT_ALIAS(switch3), gpios);
 ThreePosSwitch switches[N_SWITCHES];
 
 static const struct device *i2c_dev = DEVICE_DT_GET(DT_NODELABEL(i2c1));
+// Longest wait for the initial port reads
+#define PORTS_TIMEOUT_MS 100
 static uint8_t ports[2];
+// Port reads queued by the previous update, the status is -EINPROGRESS until
+// the I2C service has read the port
+static uint8_t ports_read[2];
+static volatile int ports_status[2];
+
+/// @brief Queue the reads of the input ports for the next update
+static void queue_port_reads() {
+  for (int j = 0; j < 2; j++) {
+    i2cRead(PORT_EXPANDER_ADDR0, INPUT_PORTS_ADDR[j], &ports_read[j],
+            &ports_status[j]);
+  }
+}
 
 // Hardcoded port and bit assignment function
 // There is no other way
@@ -89,15 +105,23 @@ int init_peripherals() {
     return 1;
   }
 
-  // Get the initial state of the device
-  int ret = 0;
+  // Get the initial state of the device, through the I2C service which owns
+  // the bus. The codec configuration may be queued ahead
+  queue_port_reads();
+  int64_t deadline = k_uptime_get() + PORTS_TIMEOUT_MS;
   for (int j = 0; j < 2; j++) {
-    ret = i2c_write_read(i2c_dev, PORT_EXPANDER_ADDR0, &INPUT_PORTS_ADDR[j], 1,
-                         &ports[j], 1);
-    if (ret != 0) {
+    while (ports_status[j] == -EINPROGRESS) {
+      if (k_uptime_get() >= deadline) {
+        printuln("Timeout reading port expander.");
+        return -EAGAIN;
+      }
+      k_msleep(1);
+    }
+    if (ports_status[j] != 0) {
       printuln("Failed reading port expander.");
-      return ret;
+      return ports_status[j];
     }
+    ports[j] = ports_read[j];
   }
 
   // Instantiate the rotary encoders
@@ -121,22 +145,39 @@ int init_peripherals() {
   switches[EFFECTS_TARGET_SW].initialize(&sw2_up, &sw2_dn);
   switches[EFFECTS_CONF_SW].initialize(&sw3_up, &sw3_dn);
 
+  queue_port_reads();
+
   printuln("Peripherals initialization completed!");
 
   return 0;
 }
 
 int peripherals_update() {
+  // The ports are read by the I2C service between two updates, so that the
+  // audio loop never waits for the bus. Polled again next time if the reads
+  // are late
+  for (int j = 0; j < 2; j++) {
+    if (ports_status[j] == -EINPROGRESS) {
+      return 0;
+    }
+  }
+
   // Get the new ports states
   int ret = 0;
   for (int j = 0; j < 2; j++) {
-    ret = i2c_write_read(i2c_dev, PORT_EXPANDER_ADDR0, &INPUT_PORTS_ADDR[j], 1,
-                         &ports[j], 1);
-    if (ret != 0) {
-      printuln("Failed reading port expander.");
-      return ret;
+    if (ports_status[j] != 0) {
+      ret = ports_status[j];
     }
   }
+  if (ret == 0) {
+    ports[0] = ports_read[0];
+    ports[1] = ports_read[1];
+  }
+  queue_port_reads();
+  if (ret != 0) {
+    printuln("Failed reading port expander.");
+    return ret;
+  }
 
   // Update the switches
   for (int i = 0; i < N_SWITCHES; i++) {
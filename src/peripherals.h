@@ -36,6 +36,12 @@ const uint8_t AMP_MOD_SUS_ENC = 4;
 // Encoder for configuring amplitude modulator release
 const uint8_t AMP_REL_ENC = 5;
 
+// Special effects parameters, multiplexed with the LFO and amplitude
+// modulator encoders
+const uint8_t FX_PARAM0_ENC = 3;
+const uint8_t FX_PARAM1_ENC = 4;
+const uint8_t FX_PARAM2_ENC = 5;
+
 /// @brief Peripheral switches
 extern ThreePosSwitch switches[N_SWITCHES];
 
@@ -56,6 +62,8 @@ const uint8_t EFFECTS_CONF_SW = 3;
 int init_peripherals();
 
 /// @brief Call this function to update the encoders and switches
+/// Never waits for the bus: the port expander is read by the I2C service
+/// between two updates, the update is skipped while the reads are pending
 /// @return 0 on success, -ERRNO otherwise
 int peripherals_update();
 
@@ -0,0 +1,326 @@
+#include "preset.hpp"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/atomic.h>
+
+#include "audio.h"
+#include "key.hpp"
+#include "trace.h"
+#include "usb.h"
+
+// Below the main thread, like the analyzer. The priority does not protect the
+// audio: the STM32F407 flash is a single bank, a sector erase stalls every
+// fetch from flash, interrupts and drivers included, for 1 to 2 s. A save is
+// therefore written with the output muted, see save_step()
+#define PRESET_STACK_SIZE 1536
+#define PRESET_PRIORITY K_LOWEST_APPLICATION_THREAD_PRIO
+K_THREAD_STACK_DEFINE(preset_stack, PRESET_STACK_SIZE);
+static struct k_work_q preset_queue;
+static bool preset_queue_started = false;
+
+// Patch captured by preset_save(), written by the work queue
+static patch_t saving;
+static uint8_t saving_slot;
+static atomic_t save_busy = ATOMIC_INIT(0);
+// Queued by preset_save(), faded out by the next block, then written
+static enum {
+  SAVE_IDLE,
+  SAVE_QUEUED,
+  SAVE_FADING,
+  SAVE_WRITING
+} save_state = SAVE_IDLE;
+
+// Patch read from flash, waiting for the next block boundary
+static patch_t staging;
+static bool pending = false;
+
+// Preset command parser state
+static enum { PRESET_IDLE, PRESET_OP, PRESET_SLOT } parser = PRESET_IDLE;
+static uint8_t preset_op;
+
+/// @brief Copy the synthesizer parameters into a patch
+/// @param patch the patch
+static void patch_capture(patch_t &patch) {
+  memset(&patch, 0, sizeof(patch));
+  patch.magic = PATCH_MAGIC;
+  patch.version = PATCH_VERSION;
+  patch.size = sizeof(patch_t);
+  patch.master_volume_enc = synth._master_volume_enc;
+
+  for (int i = 0; i < 2; i++) {
+    const osc_t &osc = i == 0 ? synth._osc1 : synth._osc2;
+    osc_patch_t &dst = patch.osc[i];
+    dst.volume = osc.volume;
+    dst.wave = osc.wave;
+    dst.enabled = osc.enabled;
+    dst.wt_position = osc.wt_position;
+    dst.volume_enc = osc.volume_enc;
+    dst.wave_enc = osc.wave_enc;
+    dst.freq_shift_enc = osc.freq_shift_enc;
+    dst.freq_shift = osc.freq_shift;
+  }
+
+  patch.cutoff_enc = synth._lpf._cutoff_enc;
+  patch.resonance_enc = synth._lpf._resonance_enc;
+
+  for (int i = 0; i < N_LFOS; i++) {
+    const LFO &lfo = synth._lfos[i];
+    lfo_patch_t &dst = patch.lfos[i];
+    dst.frequency = lfo._frequency;
+    dst.amplitude = lfo._amplitude;
+    dst.shape = lfo._shape;
+    dst.frequency_enc = lfo._frequency_enc;
+    dst.amplitude_enc = lfo._amplitude_enc;
+  }
+
+  memcpy(patch.depth, synth._matrix._depth, sizeof(patch.depth));
+  patch.unison = synth._unison;
+  patch.pitch.bend = synth._pitch.bend;
+  patch.pitch.bend_ratio = synth._pitch.bend_ratio;
+  patch.pitch.glide_time = synth._pitch.glide_time;
+  patch.pitch.glide_rate = synth._pitch.glide_rate;
+  patch.pitch.bend_enc = synth._pitch.bend_enc;
+  patch.pitch.glide_enc = synth._pitch.glide_enc;
+  patch.fm = synth._fm;
+  patch.envelope = synth._envelope;
+  patch.shaper = synth._shaper;
+  patch.chorus = synth._chorus;
+  patch.delay = synth._delay;
+#if REVERB_ENABLED
+  patch.reverb = synth._reverb;
+#endif
+  patch.octave = keyboard_octave;
+}
+
+/// @brief Copy a patch into the synthesizer parameters
+/// No callback is called, the derived values are part of the patch
+/// @param patch the patch
+static void patch_restore(const patch_t &patch) {
+  synth._master_volume_enc = patch.master_volume_enc;
+  synth._master_gain = get_master_gain(synth._master_volume_enc);
+
+  for (int i = 0; i < 2; i++) {
+    osc_t &osc = i == 0 ? synth._osc1 : synth._osc2;
+    const osc_patch_t &src = patch.osc[i];
+    osc.volume = src.volume;
+    osc.wave = (wavetype_t)src.wave;
+    osc.enabled = src.enabled;
+    osc.wt_position = src.wt_position;
+    osc.volume_enc = src.volume_enc;
+    osc.wave_enc = src.wave_enc;
+    osc.freq_shift_enc = src.freq_shift_enc;
+    osc.freq_shift = src.freq_shift;
+  }
+
+  synth._lpf._cutoff_enc = patch.cutoff_enc;
+  synth._lpf._resonance_enc = patch.resonance_enc;
+
+  for (int i = 0; i < N_LFOS; i++) {
+    LFO &lfo = synth._lfos[i];
+    const lfo_patch_t &src = patch.lfos[i];
+    lfo._frequency = src.frequency;
+    lfo._amplitude = src.amplitude;
+    lfo._shape = (lfo_shape_t)src.shape;
+    lfo._frequency_enc = src.frequency_enc;
+    lfo._amplitude_enc = src.amplitude_enc;
+  }
+
+  memcpy(synth._matrix._depth, patch.depth, sizeof(patch.depth));
+  synth._matrix._dirty = true;
+  synth._unison = patch.unison;
+  synth._pitch.bend = patch.pitch.bend;
+  synth._pitch.bend_ratio = patch.pitch.bend_ratio;
+  synth._pitch.glide_time = patch.pitch.glide_time;
+  synth._pitch.glide_rate = patch.pitch.glide_rate;
+  synth._pitch.bend_enc = patch.pitch.bend_enc;
+  synth._pitch.glide_enc = patch.pitch.glide_enc;
+  synth._fm = patch.fm;
+  synth._envelope = patch.envelope;
+  synth._shaper = patch.shaper;
+  synth._chorus = patch.chorus;
+  synth._delay = patch.delay;
+#if REVERB_ENABLED
+  synth._reverb = patch.reverb;
+#endif
+  Key::shift_octave(patch.octave - keyboard_octave);
+
+  // The filter coefficients and phase increments are derived at control rate
+  synth._dirty = DIRTY_ALL;
+  load_encoders();
+}
+
+/// @brief Copy a stored preset into the staging patch
+static int load_direct(const char *key, size_t len, settings_read_cb read_cb,
+                       void *cb_arg, void *param) {
+  patch_t *patch = (patch_t *)param;
+
+  if (len != sizeof(patch_t)) {
+    return -EINVAL;
+  }
+  if (read_cb(cb_arg, patch, len) != (ssize_t)len) {
+    return -EIO;
+  }
+
+  return 0;
+}
+
+/// @brief Preset settings key of a slot
+static void slot_name(char *name, size_t size, uint8_t slot) {
+  snprintf(name, size, PRESET_SUBTREE "/%u", slot);
+}
+
+static void save_handler(struct k_work *work) {
+  char name[sizeof(PRESET_SUBTREE "/255")];
+
+  slot_name(name, sizeof(name), saving_slot);
+  int ret = settings_save_one(name, &saving, sizeof(saving));
+  printuln("[Preset] Slot %d saved: %d", saving_slot, ret);
+
+  atomic_clear(&save_busy);
+}
+
+K_WORK_DEFINE(save_work, save_handler);
+
+void preset_init() {
+  uint32_t start = k_cycle_get_32();
+
+  int ret = settings_subsys_init();
+  if (ret < 0) {
+    printuln("[Preset] Storage not available (%d), presets are disabled", ret);
+    return;
+  }
+
+  k_work_queue_start(&preset_queue, preset_stack,
+                     K_THREAD_STACK_SIZEOF(preset_stack), PRESET_PRIORITY,
+                     NULL);
+  k_thread_name_set(&preset_queue.thread, "preset");
+  preset_queue_started = true;
+
+  if (preset_load(0) == 0) {
+    printuln("[Preset] Slot 0 loaded in %u cycles",
+             k_cycle_get_32() - start);
+  }
+}
+
+int preset_save(uint8_t slot) {
+  if (slot >= N_PRESETS) {
+    return -EINVAL;
+  }
+  if (!preset_queue_started) {
+    return -ENODEV;
+  }
+  if (!atomic_cas(&save_busy, 0, 1)) {
+    return -EBUSY;
+  }
+
+  // Captured between two blocks, the patch is consistent
+  patch_capture(saving);
+  saving_slot = slot;
+  save_state = SAVE_QUEUED;
+  return 0;
+}
+
+/// @brief Advance a save by a block
+/// A write may erase a sector and stall the CPU, the I2S DMA then plays the
+/// queued blocks and runs dry. The output is faded out by a block first, so
+/// that the queued blocks end in silence and the drop-out is silent, and
+/// faded back in once the patch is written
+static void save_step() {
+  switch (save_state) {
+  case SAVE_IDLE:
+    break;
+  case SAVE_QUEUED:
+    synth._muted = true;
+    save_state = SAVE_FADING;
+    break;
+  case SAVE_FADING:
+    // The block rendered since faded out, the rest are silent
+    k_work_submit_to_queue(&preset_queue, &save_work);
+    save_state = SAVE_WRITING;
+    break;
+  case SAVE_WRITING:
+    if (!preset_saving()) {
+      synth._muted = false;
+      save_state = SAVE_IDLE;
+    }
+    break;
+  }
+}
+
+bool preset_saving() { return atomic_get(&save_busy) != 0; }
+
+int preset_load(uint8_t slot) {
+  char name[sizeof(PRESET_SUBTREE "/255")];
+
+  if (slot >= N_PRESETS) {
+    return -EINVAL;
+  }
+
+  // A patch still waiting to be applied is replaced
+  pending = false;
+  staging.magic = 0;
+  slot_name(name, sizeof(name), slot);
+
+  int ret = settings_load_subtree_direct(name, load_direct, &staging);
+  if (ret < 0) {
+    return ret;
+  }
+  if (staging.magic != PATCH_MAGIC) {
+    return -ENOENT;
+  }
+  if (staging.version != PATCH_VERSION || staging.size != sizeof(patch_t)) {
+    printuln("[Preset] Slot %d has patch version %d, expected %d", slot,
+             staging.version, PATCH_VERSION);
+    return -ENOTSUP;
+  }
+
+  pending = true;
+  return 0;
+}
+
+void preset_apply() {
+  save_step();
+
+  if (!pending) {
+    return;
+  }
+
+  TRACE(TRACE_PRESET, 0, 0, 0);
+  patch_restore(staging);
+  pending = false;
+}
+
+bool preset_feed(uint8_t byte) {
+  switch (parser) {
+  case PRESET_IDLE:
+    if (byte != PRESET_START) {
+      return false;
+    }
+    parser = PRESET_OP;
+    break;
+  case PRESET_OP:
+    preset_op = byte;
+    parser = PRESET_SLOT;
+    break;
+  case PRESET_SLOT: {
+    parser = PRESET_IDLE;
+
+    int ret = -EINVAL;
+    if (preset_op == 'S') {
+      ret = preset_save(byte);
+    } else if (preset_op == 'L') {
+      ret = preset_load(byte);
+    }
+    printuln("[Preset] %c slot %d: %d", preset_op, byte, ret);
+    break;
+  }
+  }
+
+  return true;
+}
+
+bool preset_receiving() { return parser != PRESET_IDLE; }
@@ -0,0 +1,120 @@
+#ifndef PRESET_H
+#define PRESET_H
+
+#include "synth.hpp"
+#include <stdint.h>
+
+/// @brief Number of preset slots, slot 0 is restored at boot
+const uint8_t N_PRESETS = 8;
+
+/// @brief Settings subtree of the presets, one key per slot
+#define PRESET_SUBTREE "synth/preset"
+
+/// @brief Patch format identifier and version
+/// Bump the version whenever patch_t changes, older patches are then ignored
+const uint16_t PATCH_MAGIC = 0x5350; // "PS"
+const uint16_t PATCH_VERSION = 7;
+
+/**
+ * Preset protocol, over the CDC port:
+ *   0x04 (EOT), 'S' (save) or 'L' (load), slot
+ * Loaded presets are applied at the next block boundary.
+ */
+const uint8_t PRESET_START = 0x04;
+
+/// @brief Oscillator part of a patch, without the wavetable render cache
+typedef struct osc_patch {
+  uint16_t volume;
+  uint8_t wave;
+  uint8_t enabled;
+  uint16_t wt_position;
+  int16_t volume_enc;
+  int16_t wave_enc;
+  int16_t freq_shift_enc;
+  float freq_shift;
+} osc_patch_t;
+
+/// @brief LFO part of a patch, without the running phase
+typedef struct lfo_patch {
+  float frequency;
+  float amplitude;
+  uint8_t shape;
+  int16_t frequency_enc;
+  int16_t amplitude_enc;
+} lfo_patch_t;
+
+/// @brief Pitch part of a patch, without the glide start of the last note
+typedef struct pitch_patch {
+  float bend;
+  float bend_ratio;
+  float glide_time;
+  float glide_rate;
+  int16_t bend_enc;
+  int16_t glide_enc;
+} pitch_patch_t;
+
+/// @brief Binary patch, stored as is in flash
+/// The parameter structs are stored with their derived values, so that a
+/// recall is a plain copy without recomputation
+typedef struct patch {
+  uint16_t magic;
+  uint16_t version;
+  uint16_t size; // sizeof(patch_t), rejects layouts of other builds
+  int16_t master_volume_enc;
+  osc_patch_t osc[2];
+  int16_t cutoff_enc;
+  int16_t resonance_enc;
+  lfo_patch_t lfos[N_LFOS];
+  int8_t depth[N_MOD_SOURCES][N_MOD_DESTS];
+  unison_t unison;
+  pitch_patch_t pitch;
+  fm_t fm;
+  envelope_t envelope;
+  shaper_t shaper;
+  chorus_t chorus;
+  delay_t delay;
+#if REVERB_ENABLED
+  reverb_t reverb;
+#endif
+  int8_t octave;
+} patch_t;
+
+/// @brief Initialize the preset storage and load slot 0, if saved
+/// Call this function once the synthesizer is initialized
+void preset_init();
+
+/// @brief Save the current patch into a slot
+/// The patch is captured now and written to flash by the preset work queue.
+/// A write can erase a flash sector, which stalls the whole CPU for 1 to 2 s
+/// on the single bank flash: preset_apply() fades the output out by a block
+/// before the write and back in after it, the audio drops out silently. The
+/// result is printed once written
+/// @param slot the preset slot
+/// @return 0 if the save is queued, -EBUSY while the previous one is being
+/// written, -ERRNO otherwise
+int preset_save(uint8_t slot);
+
+/// @brief Check whether a saved patch is still being written to flash
+/// @return true until the last queued save is written
+bool preset_saving();
+
+/// @brief Load a slot, the patch is applied by the next preset_apply()
+/// @param slot the preset slot
+/// @return 0 on success, -ERRNO otherwise
+int preset_load(uint8_t slot);
+
+/// @brief Apply the loaded patch, if any, and advance a queued save
+/// Call this function between two blocks, so that a block is never rendered
+/// with half of a patch
+void preset_apply();
+
+/// @brief Feed one byte received from the host to the preset parser
+/// @param byte the received byte
+/// @return true if the byte belongs to a preset command, false otherwise
+bool preset_feed(uint8_t byte);
+
+/// @brief Check whether a preset command is being received
+/// @return true if the parser is in the middle of a command
+bool preset_receiving();
+
+#endif // PRESET_H
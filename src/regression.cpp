@@ -0,0 +1,630 @@
+#include "regression.h"
+
+#if REGRESSION_CHECK
+
+#include <math.h>
+#include <string.h>
+
+#include "audio.h"
+#include "key.hpp"
+#include "synth.hpp"
+#include "usb.h"
+
+/// @brief Frequency of the lowest fingerprint bin, the others are a third
+/// of an octave apart
+static const float BIN_LOWEST = 100.;
+
+/// @brief Blocks rendered by the voice scenarios
+static const int REGRESSION_BLOCKS = 3;
+
+/// @brief Fingerprint of a render in progress
+typedef struct accumulator {
+  uint32_t checksum;
+  float energy;
+  uint32_t count;
+  float coeff[REGRESSION_BINS]; // Goertzel filters
+  float s1[REGRESSION_BINS];
+  float s2[REGRESSION_BINS];
+} accumulator_t;
+
+/// @brief A scenario renders into the accumulator from the default
+/// synthesizer parameters
+typedef struct scenario {
+  const char *name;
+  bool exact; // integer path, compared bit for bit
+  void (*render)(accumulator_t &acc);
+} scenario_t;
+
+/// @brief Golden fingerprint of a scenario, found by its name
+typedef struct golden {
+  const char *name;
+  fingerprint_t print;
+} golden_t;
+
+// Default parameters every scenario starts from, and the boot ones restored
+// at the end. Too large for the main stack
+static Synthesizer clean;
+static Synthesizer saved;
+static Key saved_keys[MAX_KEYS];
+
+static uint8_t block[BLOCK_SIZE];
+
+static void accumulate(accumulator_t &acc, const int16_t *x, int n) {
+  for (int i = 0; i < n; i++) {
+    // FNV-1a, one byte at a time
+    uint16_t sample = (uint16_t)x[i];
+    acc.checksum = (acc.checksum ^ (sample & 0xFF)) * 16777619u;
+    acc.checksum = (acc.checksum ^ (sample >> 8)) * 16777619u;
+
+    float value = x[i];
+    acc.energy += value * value;
+    for (int k = 0; k < REGRESSION_BINS; k++) {
+      float s = value + acc.coeff[k] * acc.s1[k] - acc.s2[k];
+      acc.s2[k] = acc.s1[k];
+      acc.s1[k] = s;
+    }
+  }
+  acc.count += n;
+}
+
+static void fingerprint(const accumulator_t &acc, fingerprint_t &print) {
+  print.checksum = acc.checksum;
+  print.rms = (uint32_t)(sqrtf(acc.energy / acc.count) + 0.5f);
+
+  // Amplitude of a sine at the bin frequency
+  for (int k = 0; k < REGRESSION_BINS; k++) {
+    float power = acc.s1[k] * acc.s1[k] + acc.s2[k] * acc.s2[k] -
+                  acc.coeff[k] * acc.s1[k] * acc.s2[k];
+    print.bins[k] = (uint32_t)(sqrtf(power > 0.f ? power : 0.f) * 2.f /
+                                   acc.count +
+                               0.5f);
+  }
+}
+
+/// @brief Start from the default parameters and idle keys
+static void reset() {
+  synth = clean;
+  for (int j = 0; j < MAX_KEYS; j++) {
+    keys[j] = Key();
+  }
+}
+
+/// @brief Hold notes and render blocks through makesynth
+/// @param acc the accumulator
+/// @param notes the MIDI notes, one key each
+/// @param n number of notes
+/// @param blocks number of blocks
+static void render_notes(accumulator_t &acc, const uint8_t *notes, int n,
+                         int blocks) {
+  for (int j = 0; j < n; j++) {
+    synth.start_voice(keys[j], notes[j]);
+    synth.hold(keys[j], 10000);
+  }
+
+  for (int b = 0; b < blocks; b++) {
+    synth.makesynth(block);
+    accumulate(acc, (int16_t *)block, SAMPLES_PER_BLOCK);
+  }
+}
+
+/// @brief Render a single A3 on oscillator 1
+/// @param acc the accumulator
+/// @param wave the oscillator wave
+static void render_voice(accumulator_t &acc, wavetype_t wave) {
+  static const uint8_t A3[] = {57};
+  synth._osc1.enabled = true;
+  synth._osc1.wave = wave;
+  synth._osc1.wt_position = 3 * WT_POSITION_PER_FRAME / 2;
+  render_notes(acc, A3, 1, REGRESSION_BLOCKS);
+}
+
+/// @brief Render an oscillator wave directly, swept across the phase
+/// @param acc the accumulator
+/// @param wave the oscillator wave
+static void render_wave(accumulator_t &acc, wavetype_t wave) {
+  int16_t *x = (int16_t *)block;
+  synth._osc1.wave = wave;
+  synth._osc1.wt_position = 3 * WT_POSITION_PER_FRAME / 2;
+  synth.update_wavetable(synth._osc1, MOD_OSC1_WAVE);
+
+  // Coprime with 2^16, every phase is visited
+  uint16_t phase = 0;
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+    x[i] = (int16_t)(synth.get_osc_sample(synth._osc1, phase) >> 1);
+    phase += 1187;
+  }
+  accumulate(acc, x, SAMPLES_PER_BLOCK);
+}
+
+/// @brief Fill the block with an impulse followed by a low ramp
+/// @param amplitude the impulse amplitude
+static int16_t *fill_impulse(int16_t amplitude) {
+  int16_t *x = (int16_t *)block;
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+    x[i] = (int16_t)((i % 441) * 8);
+  }
+  x[0] = amplitude;
+  return x;
+}
+
+static void wave_sine(accumulator_t &acc) { render_wave(acc, sine); }
+static void wave_triangle(accumulator_t &acc) { render_wave(acc, triangle); }
+static void wave_square(accumulator_t &acc) { render_wave(acc, square); }
+static void wave_sawtooth(accumulator_t &acc) { render_wave(acc, sawtooth); }
+static void wave_table(accumulator_t &acc) { render_wave(acc, wavetable); }
+
+/// @brief The delay parameters are set directly, delay_update uses libm
+static void delay_lines(accumulator_t &acc) {
+  delay_t params = {};
+  params.length = 1000;
+  params.feedback = 20000;
+  params.mix = 16384;
+  params.damping = 16384;
+
+  for (int b = 0; b < 4; b++) {
+    int16_t *x = b == 0 ? fill_impulse(30000) : (int16_t *)block;
+    if (b > 0) {
+      memset(block, 0, sizeof(block));
+    }
+    synth._echo.process(x, SAMPLES_PER_BLOCK, params);
+    accumulate(acc, x, SAMPLES_PER_BLOCK);
+  }
+}
+
+/// @brief Full feedback and mix on a full scale square, every sum saturates
+static void delay_saturation(accumulator_t &acc) {
+  delay_t params = {};
+  params.length = 300;
+  params.feedback = 32767;
+  params.mix = 32767;
+  params.damping = 32767;
+
+  int16_t *x = (int16_t *)block;
+  for (int b = 0; b < 2; b++) {
+    for (int i = 0; i < SAMPLES_PER_BLOCK; i++) {
+      x[i] = (i / 50) % 2 ? 32767 : -32768;
+    }
+    synth._echo.process(x, SAMPLES_PER_BLOCK, params);
+    accumulate(acc, x, SAMPLES_PER_BLOCK);
+  }
+}
+
+#if REVERB_ENABLED
+static void reverb_tail(accumulator_t &acc) {
+  reverb_t params = {};
+  params.feedback = 27525;
+  params.damping = 6553;
+  params.wet = 16384;
+
+  for (int b = 0; b < 4; b++) {
+    int16_t *x = b == 0 ? fill_impulse(30000) : (int16_t *)block;
+    if (b > 0) {
+      memset(block, 0, sizeof(block));
+    }
+    synth._room.process(x, SAMPLES_PER_BLOCK, params);
+    accumulate(acc, x, SAMPLES_PER_BLOCK);
+  }
+}
+#endif
+
+static void voice_sine(accumulator_t &acc) { render_voice(acc, sine); }
+static void voice_triangle(accumulator_t &acc) { render_voice(acc, triangle); }
+static void voice_square(accumulator_t &acc) { render_voice(acc, square); }
+static void voice_sawtooth(accumulator_t &acc) { render_voice(acc, sawtooth); }
+static void voice_table(accumulator_t &acc) { render_voice(acc, wavetable); }
+
+static const uint8_t CHORD[] = {48, 55, 60, 64};
+
+/// @brief Both oscillators, the second a fifth above
+static void chord(accumulator_t &acc) {
+  synth._osc1.enabled = true;
+  synth._osc1.wave = sawtooth;
+  synth._osc2.enabled = true;
+  synth._osc2.wave = sawtooth;
+  synth._osc2.freq_shift = SHIFT_FREQUENCIES[31];
+  render_notes(acc, CHORD, MAX_KEYS, REGRESSION_BLOCKS);
+}
+
+/// @brief The cut-off rises every block, with a high resonance
+static void filter_sweep(accumulator_t &acc) {
+  synth._osc1.enabled = true;
+  synth._osc1.wave = sawtooth;
+  synth._lpf._resonance_enc = 36;
+  synth._lpf._cutoff_enc = 16;
+  render_notes(acc, CHORD, MAX_KEYS, 1);
+
+  for (int cutoff = 32; cutoff < 96; cutoff += 16) {
+    synth._lpf._cutoff_enc = cutoff;
+    synth._dirty |= DIRTY_FILTER;
+    synth.makesynth(block);
+    accumulate(acc, (int16_t *)block, SAMPLES_PER_BLOCK);
+  }
+}
+
+/// @brief A 20 Hz LFO on one target at full level, everything it can
+/// modulate is on. The oscillators are a fifth apart, so that each target
+/// sounds different
+/// @param acc the accumulator
+/// @param target the LFO and its default target
+static void render_lfo(accumulator_t &acc, lfo_target_t target) {
+  static const uint8_t A3[] = {57};
+  synth._osc1.enabled = true;
+  synth._osc1.wave = wavetable;
+  synth._osc1.wt_position = WT_POSITION_PER_FRAME;
+  synth._osc2.enabled = true;
+  synth._osc2.wave = wavetable;
+  synth._osc2.wt_position = WT_POSITION_PER_FRAME;
+  synth._osc2.freq_shift = SHIFT_FREQUENCIES[31];
+  synth._lpf._cutoff_enc = 48;
+  synth._lfos[target].set_frequency(20.);
+  synth._lfos[target].set_amplitude(LFO_MAX_AMPLITUDE);
+  synth._matrix._dirty = true;
+  render_notes(acc, A3, 1, REGRESSION_BLOCKS);
+}
+
+static void lfo_osc1_freq(accumulator_t &acc) { render_lfo(acc, OSC1_FREQ); }
+static void lfo_osc2_freq(accumulator_t &acc) { render_lfo(acc, OSC2_FREQ); }
+static void lfo_osc1_amp(accumulator_t &acc) { render_lfo(acc, OSC1_AMP); }
+static void lfo_osc2_amp(accumulator_t &acc) { render_lfo(acc, OSC2_AMP); }
+static void lfo_cutoff(accumulator_t &acc) { render_lfo(acc, LPF_CUTOFF); }
+static void lfo_osc1_wave(accumulator_t &acc) { render_lfo(acc, OSC1_WAVE); }
+static void lfo_osc2_wave(accumulator_t &acc) { render_lfo(acc, OSC2_WAVE); }
+
+/// @brief Every voice at full volume on both oscillators, the mix clips
+static void clipping(accumulator_t &acc) {
+  synth._osc1.enabled = true;
+  synth._osc1.wave = square;
+  synth._osc1.volume = 0xFFFF;
+  synth._osc2.enabled = true;
+  synth._osc2.wave = square;
+  synth._osc2.volume = 0xFFFF;
+  render_notes(acc, CHORD, MAX_KEYS, REGRESSION_BLOCKS);
+}
+
+static void voice_core_2x(accumulator_t &acc) {
+  synth.set_oversampling(QUALITY_OVERSAMPLING);
+  render_voice(acc, sawtooth);
+}
+
+static void fm(accumulator_t &acc) {
+  synth._osc2.enabled = true;
+  synth._osc2.wave = sine;
+  synth._osc2.freq_shift = SHIFT_FREQUENCIES[36];
+  synth._fm.index = 512;
+  synth._fm_index = 512;
+  render_voice(acc, sine);
+}
+
+static void unison(accumulator_t &acc) {
+  synth._unison.voices = 4;
+  synth._unison.detune = 25.;
+  synth._unison.mix = 0.5;
+  unison_update(synth._unison);
+  render_voice(acc, sawtooth);
+}
+
+static void distortion(accumulator_t &acc) {
+  synth._shaper.drive_enc = 20;
+  synth._shaper.level_enc = 32;
+  synth._shaper.factor_enc = 1;
+  shaper_update(synth._shaper);
+  render_voice(acc, sawtooth);
+}
+
+static void chorus(accumulator_t &acc) {
+  synth._chorus.mix_enc = 16;
+  synth._chorus.depth_enc = 16;
+  chorus_update(synth._chorus);
+  render_voice(acc, sawtooth);
+}
+
+static const scenario_t SCENARIOS[] = {
+    {"wave sine", true, wave_sine},
+    {"wave triangle", true, wave_triangle},
+    {"wave square", true, wave_square},
+    {"wave sawtooth", true, wave_sawtooth},
+    {"wave wavetable", true, wave_table},
+    {"delay", true, delay_lines},
+    {"delay saturation", true, delay_saturation},
+#if REVERB_ENABLED
+    {"reverb", true, reverb_tail},
+#endif
+    {"voice sine", false, voice_sine},
+    {"voice triangle", false, voice_triangle},
+    {"voice square", false, voice_square},
+    {"voice sawtooth", false, voice_sawtooth},
+    {"voice wavetable", false, voice_table},
+    {"chord", false, chord},
+    {"filter sweep", false, filter_sweep},
+    {"lfo osc1 freq", false, lfo_osc1_freq},
+    {"lfo osc2 freq", false, lfo_osc2_freq},
+    {"lfo osc1 amp", false, lfo_osc1_amp},
+    {"lfo osc2 amp", false, lfo_osc2_amp},
+    {"lfo cutoff", false, lfo_cutoff},
+    {"lfo osc1 wave", false, lfo_osc1_wave},
+    {"lfo osc2 wave", false, lfo_osc2_wave},
+    {"clipping", false, clipping},
+    {"voice core 2x", false, voice_core_2x},
+    {"fm", false, fm},
+    {"unison", false, unison},
+    {"distortion", false, distortion},
+    {"chorus", false, chorus},
+};
+
+static const int N_SCENARIOS = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+
+// Fingerprints of the scenarios, printed together with REGRESSION_UPDATE
+static fingerprint_t prints[N_SCENARIOS];
+
+// Golden fingerprints. Regenerated by tools/update_goldens.sh, or by hand
+// from the row a failed scenario prints, once the change of sound is intended
+static const golden_t GOLDEN[] = {
+    // Rendered at 6253b3a by an x86-64 GCC build of the scenarios
+    {"wave sine",
+     {0x914eb081, 11587,
+      {14, 211, 42, 19, 257, 92, 37, 288,
+       411, 16282, 451, 176, 16, 19, 16, 11,
+       13, 8, 8, 7, 4, 4, 4, 3}}},
+    {"wave triangle",
+     {0x8c45a6be, 9451,
+      {44, 72, 36, 46, 80, 23, 57, 191,
+       247, 13182, 432, 208, 8, 51, 38, 8,
+       59, 4, 6, 13, 4, 2, 11, 4}}},
+    {"wave square",
+     {0x8af163ed, 16384,
+      {15, 231, 178, 124, 357, 179, 110, 430,
+       544, 20724, 541, 176, 44, 29, 151, 41,
+       282, 65, 28, 80, 24, 25, 120, 123}}},
+    {"wave sawtooth",
+     {0x22813345, 9448,
+      {61, 153, 64, 99, 204, 105, 79, 255,
+       341, 10345, 214, 33, 5069, 30, 56, 2334,
+       159, 93, 817, 38, 40, 10, 74, 69}}},
+    {"wave wavetable",
+     {0x8a09b70b, 9450,
+      {12, 182, 79, 32, 215, 83, 27, 220,
+       416, 12296, 321, 146, 148, 6, 75, 137,
+       111, 40, 99, 25, 7, 7, 54, 24}}},
+    {"delay",
+     {0xe6e13e48, 1502,
+      {233, 60, 2, 98, 16, 13, 120, 40,
+       6, 42, 34, 6, 15, 7, 4, 6,
+       6, 7, 8, 10, 5, 5, 6, 7}}},
+    {"delay saturation",
+     {0xf71f7c74, 32656,
+      {108, 700, 416, 121, 484, 1197, 760, 1663,
+       456, 80, 43, 363, 161, 101, 105, 249,
+       152, 61, 38, 22, 402, 929, 15, 18}}},
+    {"reverb",
+     {0xda0e8c1b, 1078,
+      {311, 56, 5, 127, 19, 19, 74, 53,
+       9, 35, 33, 5, 13, 13, 6, 8,
+       12, 6, 5, 9, 6, 4, 10, 7}}},
+    {"voice sine",
+     {0xb6dac53c, 14777,
+      {109, 128, 371, 103, 868, 406, 80, 98,
+       14, 23, 9, 6, 4, 1, 2, 1,
+       1, 0, 0, 0, 0, 0, 0, 0}}},
+    {"voice triangle",
+     {0x33d32ea9, 12066,
+      {113, 62, 227, 110, 764, 388, 96, 119,
+       93, 58, 30, 40, 28, 32, 17, 14,
+       12, 9, 7, 6, 5, 4, 3, 3}}},
+    {"voice square",
+     {0x3e71053b, 20904,
+      {213, 200, 526, 196, 1072, 553, 135, 108,
+       596, 21, 83, 42, 52, 138, 27, 110,
+       9, 36, 20, 24, 21, 22, 2, 45}}},
+    {"voice sawtooth",
+     {0x20fb9448, 12038,
+      {198, 142, 289, 178, 506, 155, 133, 189,
+       310, 44, 52, 87, 35, 64, 48, 49,
+       22, 18, 26, 16, 15, 17, 2, 29}}},
+    {"voice wavetable",
+     {0xbc4011c6, 12014,
+      {143, 89, 211, 141, 709, 305, 114, 27,
+       313, 52, 61, 24, 26, 76, 21, 24,
+       9, 19, 10, 4, 6, 5, 3, 7}}},
+    {"chord",
+     {0x99b9e60c, 26328,
+      {1853, 3010, 1027, 7447, 2353, 1520, 2552, 1578,
+       322, 866, 420, 517, 147, 357, 193, 213,
+       160, 82, 107, 83, 70, 45, 47, 57}}},
+    {"filter sweep",
+     {0x03ecc6bc, 21036,
+      {458, 4369, 1990, 9777, 1212, 916, 3079, 409,
+       362, 986, 215, 31, 127, 251, 137, 71,
+       22, 15, 11, 7, 12, 6, 4, 3}}},
+    {"lfo osc1 freq",
+     {0x78d01da7, 8445,
+      {226, 152, 304, 5953, 1035, 512, 196, 42,
+       47, 31, 27, 17, 14, 11, 9, 7,
+       5, 4, 4, 3, 2, 2, 2, 2}}},
+    {"lfo osc2 freq",
+     {0x4d0e7b6b, 8428,
+      {267, 202, 182, 258, 354, 253, 130, 26,
+       11, 6, 8, 3, 2, 2, 2, 1,
+       1, 1, 1, 0, 0, 0, 0, 0}}},
+    {"lfo osc1 amp",
+     {0x27ff2979, 9928,
+      {315, 163, 259, 5958, 817, 606, 151, 17,
+       51, 15, 13, 7, 6, 4, 4, 3,
+       2, 2, 1, 1, 1, 1, 1, 1}}},
+    {"lfo osc2 amp",
+     {0x4f3fd271, 8872,
+      {273, 196, 187, 250, 514, 721, 175, 17,
+       35, 13, 29, 6, 5, 4, 3, 2,
+       2, 2, 1, 1, 1, 1, 1, 1}}},
+    {"lfo cutoff",
+     {0x6421ac42, 11058,
+      {433, 181, 2086, 5985, 953, 1221, 407, 6,
+       109, 20, 158, 13, 19, 11, 8, 6,
+       2, 3, 2, 2, 1, 1, 1, 1}}},
+    {"lfo osc1 wave",
+     {0x41a2a892, 9223,
+      {842, 210, 3427, 8068, 844, 603, 256, 33,
+       49, 3, 2, 5, 4, 4, 3, 3,
+       2, 2, 1, 1, 1, 1, 1, 1}}},
+    {"lfo osc2 wave",
+     {0xd76063a1, 8774,
+      {320, 119, 320, 205, 637, 972, 360, 40,
+       100, 21, 77, 12, 8, 8, 4, 3,
+       3, 2, 2, 1, 1, 1, 1, 1}}},
+    {"clipping",
+     {0x62d66ea7, 25148,
+      {1865, 5751, 1158, 6900, 3198, 1119, 1197, 163,
+       232, 623, 189, 121, 154, 94, 170, 327,
+       17, 73, 90, 43, 61, 59, 33, 19}}},
+    {"voice core 2x",
+     {0xb4e2e9b9, 11987,
+      {122, 103, 241, 144, 533, 162, 123, 232,
+       286, 76, 42, 48, 49, 70, 50, 43,
+       28, 16, 24, 5, 10, 12, 7, 3}}},
+    {"fm",
+     {0xedb826a9, 13576,
+      {15, 14, 13, 16, 10, 12, 12, 25,
+       99, 3, 75, 70, 79, 733, 33, 40,
+       26, 9, 4, 0, 2, 1, 1, 1}}},
+    {"unison",
+     {0x20659ab4, 8321,
+      {27, 74, 65, 82, 61, 78, 124, 34,
+       459, 162, 67, 76, 50, 46, 42, 45,
+       49, 135, 46, 31, 38, 14, 53, 11}}},
+    {"distortion",
+     {0x154bac36, 30694,
+      {138, 352, 899, 112, 1512, 704, 97, 131,
+       658, 90, 114, 74, 126, 87, 81, 78,
+       61, 32, 35, 8, 11, 14, 8, 15}}},
+    {"chorus",
+     {0x6121df34, 14017,
+      {309, 99, 339, 122, 552, 256, 31, 262,
+       319, 74, 95, 186, 27, 58, 49, 69,
+       47, 43, 9, 9, 36, 28, 11, 26}}},
+};
+
+static const int N_GOLDEN = sizeof(GOLDEN) / sizeof(GOLDEN[0]);
+
+/// @brief Find the golden fingerprint of a scenario
+/// @param name the scenario name
+/// @return the fingerprint, nullptr if the scenario has none yet
+static const fingerprint_t *find_golden(const char *name) {
+  for (int g = 0; g < N_GOLDEN; g++) {
+    if (strcmp(GOLDEN[g].name, name) == 0) {
+      return &GOLDEN[g].print;
+    }
+  }
+  return nullptr;
+}
+
+/// @brief Print the golden row of a fingerprint, as it appears in GOLDEN
+/// @param name the scenario name
+/// @param print the fingerprint
+static void print_golden(const char *name, const fingerprint_t &print) {
+  printuln("    {\"%s\",", name);
+  printuln("     {0x%08x, %u,", print.checksum, print.rms);
+  for (int k = 0; k < REGRESSION_BINS; k += 8) {
+    const uint32_t *b = &print.bins[k];
+    printuln("      %s%u, %u, %u, %u, %u, %u, %u, %u%s", k == 0 ? "{" : " ",
+             b[0], b[1], b[2], b[3], b[4], b[5], b[6], b[7],
+             k + 8 < REGRESSION_BINS ? "," : "}}},");
+  }
+}
+
+/// @brief SNR of a fingerprint against the golden one, over the RMS level
+/// and the bins
+/// @return the SNR in dB, clamped to +/-200 dB
+static int fingerprint_snr(const fingerprint_t &print,
+                           const fingerprint_t &golden) {
+  float signal = (float)golden.rms * golden.rms;
+  float error = (float)print.rms - golden.rms;
+  float noise = error * error;
+  for (int k = 0; k < REGRESSION_BINS; k++) {
+    error = (float)print.bins[k] - golden.bins[k];
+    signal += (float)golden.bins[k] * golden.bins[k];
+    noise += error * error;
+  }
+
+  if (noise * 1e20f <= signal) {
+    return 200;
+  }
+  if (signal * 1e20f <= noise) {
+    return -200;
+  }
+  return (int)(10.f * log10f(signal / noise));
+}
+
+int regression_check() {
+  saved = synth;
+  for (int j = 0; j < MAX_KEYS; j++) {
+    saved_keys[j] = keys[j];
+  }
+
+  int failed = 0;
+  for (int s = 0; s < N_SCENARIOS; s++) {
+    const scenario_t &scenario = SCENARIOS[s];
+    const fingerprint_t *golden = find_golden(scenario.name);
+
+    accumulator_t acc = {};
+    acc.checksum = 2166136261u;
+    for (int k = 0; k < REGRESSION_BINS; k++) {
+      float frequency = BIN_LOWEST * exp2f(k / 3.f);
+      acc.coeff[k] =
+          2.f * cosf(2.f * (float)M_PI * frequency / SAMPLE_FREQUENCY);
+    }
+
+    reset();
+    scenario.render(acc);
+
+    fingerprint(acc, prints[s]);
+    const fingerprint_t &print = prints[s];
+
+    bool ok;
+    if (golden == nullptr) {
+      ok = false;
+      printuln("[Regression] %s: FAIL, no golden row", scenario.name);
+    } else if (scenario.exact) {
+      ok = print.checksum == golden->checksum;
+      printuln("[Regression] %s: %s, checksum %08x", scenario.name,
+               ok ? "ok" : "FAIL", print.checksum);
+    } else {
+      int snr = fingerprint_snr(print, *golden);
+      ok = snr >= REGRESSION_MIN_SNR_DB;
+      printuln("[Regression] %s: %s, SNR %d dB", scenario.name,
+               ok ? "ok" : "FAIL", snr);
+    }
+
+    if (!ok) {
+      failed++;
+      if (!REGRESSION_UPDATE) {
+        print_golden(scenario.name, print);
+      }
+    }
+  }
+
+  printuln("[Regression] %d of %d scenarios passed", N_SCENARIOS - failed,
+           N_SCENARIOS);
+
+  if (REGRESSION_UPDATE) {
+    printuln("[Regression] Goldens begin");
+    for (int s = 0; s < N_SCENARIOS; s++) {
+      print_golden(SCENARIOS[s].name, prints[s]);
+    }
+    printuln("[Regression] Goldens end");
+  }
+
+  // The scenarios filled the effect lines, they are cleared on their next use
+  synth = saved;
+  synth._distortion._factor = 0;
+  synth._ensemble._active = false;
+  synth._echo._active = false;
+#if REVERB_ENABLED
+  synth._room._active = false;
+#endif
+  for (int j = 0; j < MAX_KEYS; j++) {
+    keys[j] = saved_keys[j];
+  }
+
+  return failed;
+}
+
+#endif // REGRESSION_CHECK
@@ -0,0 +1,49 @@
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <stdint.h>
+
+// Set to 1 to check the render output against the golden fingerprints at
+// boot, e.g. after optimizing a render kernel. Takes about 2 s. At 0 the
+// scenarios and their buffers are not built. tests/regression sets it to run
+// the check on native_sim
+#ifndef REGRESSION_CHECK
+#define REGRESSION_CHECK (0)
+#endif
+
+// Set to 1 as well to print the golden row of every scenario, whether it
+// passed or not, between "[Regression] Goldens begin" and "end" lines.
+// tools/update_goldens.sh sets it and pastes the rows in src/regression.cpp
+#ifndef REGRESSION_UPDATE
+#define REGRESSION_UPDATE (0)
+#endif
+
+/// @brief Number of spectral bins of a fingerprint, third octaves from
+/// 100 Hz to 20 kHz
+const int REGRESSION_BINS = 24;
+
+/// @brief Smallest accepted SNR of a float path fingerprint against its
+/// golden one, in dB. Fused multiply-adds stay above 70 dB, the pitch and
+/// cutoff modulation stepped at control rate instead of ramped scores 36 to
+/// 46 dB
+const int REGRESSION_MIN_SNR_DB = 60;
+
+/// @brief Fingerprint of a rendered scenario
+typedef struct fingerprint {
+  uint32_t checksum;              // FNV-1a hash of the samples
+  uint32_t rms;                   // RMS level of the samples
+  uint32_t bins[REGRESSION_BINS]; // Goertzel magnitudes, see REGRESSION_BINS
+} fingerprint_t;
+
+/// @brief Render every scenario through the synthesizer core and compare it
+/// with its golden fingerprint
+/// The integer paths (oscillator waves, delay, reverb) must match bit for
+/// bit, the float paths (voices, filter, LFOs, effects with float
+/// parameters) within REGRESSION_MIN_SNR_DB. A failed scenario, or one
+/// without a golden row, prints the row of its new golden fingerprint. The
+/// synthesizer parameters are restored afterwards. Call it once after
+/// initialization, before audio starts
+/// @return the number of failed scenarios
+int regression_check();
+
+#endif // REGRESSION_H
@@ -0,0 +1,146 @@
+#include "dsp.h"
+
+#include "reverb.hpp"
+
+#if REVERB_ENABLED
+
+#include <string.h>
+
+#include "effect.hpp"
+#include "memmap.h"
+
+// Read and written every sample, zero wait states and never used by the DMA
+DSP_STATE int16_t reverb_lines[REVERB_LINE_SAMPLES];
+
+// Comb input gain, keeps the sum of the combs within the int16 lines
+static const int32_t REVERB_INPUT_GAIN = 983; // 0.03, Q15
+
+void reverb_update(reverb_t &reverb) {
+  // Freeverb ranges: feedback 0.7 to 0.98, damping 0 to 0.4
+  reverb.feedback = (int16_t)((0.7f + 0.28f * reverb.room_enc / 32) * 32767);
+  reverb.damping = (int16_t)(0.4f * reverb.damping_enc / 32 * 32767);
+  reverb.wet = enc_level(reverb.mix_enc);
+}
+
+DSP_CODE void ReverbComb::process(const int32_t *in, int32_t *acc, int n,
+                                  const reverb_t &params) {
+  int32_t feedback = params.feedback;
+  int32_t damp1 = params.damping;
+  int32_t damp2 = 32768 - damp1;
+  int32_t store = _store;
+
+  // Split the chunk where the line wraps
+  while (n > 0) {
+    int count = _length - _pos < n ? _length - _pos : n;
+    int16_t *line = &_line[_pos];
+
+    for (int i = 0; i < count; i++) {
+      int32_t out = line[i];
+      store = (out * damp2 + store * damp1) >> 15;
+
+      // Truncated towards 0, so that the tail decays to silence instead of
+      // settling in a limit cycle
+      int32_t fed = store * feedback;
+      fed = (fed + ((fed >> 31) & 0x7fff)) >> 15;
+      line[i] = sat16(in[i] + fed);
+      acc[i] += out;
+    }
+
+    in += count;
+    acc += count;
+    n -= count;
+    _pos += count;
+    if (_pos == _length) {
+      _pos = 0;
+    }
+  }
+
+  _store = store;
+}
+
+DSP_CODE void ReverbAllpass::process(int32_t *x, int n) {
+  while (n > 0) {
+    int count = _length - _pos < n ? _length - _pos : n;
+    int16_t *line = &_line[_pos];
+
+    for (int i = 0; i < count; i++) {
+      int32_t delayed = line[i];
+      // Halved towards 0, -1 >> 1 would circulate forever
+      line[i] = sat16(x[i] + ((delayed + ((delayed >> 31) & 1)) >> 1));
+      x[i] = delayed - x[i];
+    }
+
+    x += count;
+    n -= count;
+    _pos += count;
+    if (_pos == _length) {
+      _pos = 0;
+    }
+  }
+}
+
+Reverb::Reverb() : _active{false} {
+  int16_t *line = reverb_lines;
+
+  for (int i = 0; i < REVERB_COMBS; i++) {
+    _combs[i]._line = line;
+    _combs[i]._length = reverb_length(REVERB_COMB_TUNING[i]);
+    _combs[i]._pos = 0;
+    _combs[i]._store = 0;
+    line += _combs[i]._length;
+  }
+  for (int i = 0; i < REVERB_ALLPASSES; i++) {
+    _allpasses[i]._line = line;
+    _allpasses[i]._length = reverb_length(REVERB_ALLPASS_TUNING[i]);
+    _allpasses[i]._pos = 0;
+    line += _allpasses[i]._length;
+  }
+}
+
+void Reverb::clear() {
+  memset(reverb_lines, 0, sizeof(reverb_lines));
+  for (int i = 0; i < REVERB_COMBS; i++) {
+    _combs[i]._store = 0;
+  }
+}
+
+DSP_CODE void Reverb::process(int16_t *block, int n, const reverb_t &params,
+                              gain_ramp_t *ramp) {
+  if (!effect_switch(_active, params.wet != 0, [this] { clear(); })) {
+    return;
+  }
+
+  int32_t in[REVERB_CHUNK];
+  int32_t acc[REVERB_CHUNK];
+  int32_t wet = params.wet;
+
+  for (int base = 0; base < n; base += REVERB_CHUNK) {
+    int count = n - base < REVERB_CHUNK ? n - base : REVERB_CHUNK;
+    int16_t *x = &block[base];
+
+    for (int i = 0; i < count; i++) {
+      in[i] = (x[i] * REVERB_INPUT_GAIN) >> 15;
+      acc[i] = 0;
+    }
+
+    for (int c = 0; c < REVERB_COMBS; c++) {
+      _combs[c].process(in, acc, count, params);
+    }
+
+    // Headroom for the allpass lines and the output product, made up by
+    // the output gain
+    for (int i = 0; i < count; i++) {
+      acc[i] >>= 3;
+    }
+
+    for (int a = 0; a < REVERB_ALLPASSES; a++) {
+      _allpasses[a].process(acc, count);
+    }
+
+    for (int i = 0; i < count; i++) {
+      x[i] = ramp_sample(ramp, sat16(x[i] + ((acc[i] * wet) >> 12)));
+    }
+  }
+}
+
+#endif // REVERB_ENABLED
@@ -0,0 +1,123 @@
+#ifndef REVERB_H
+#define REVERB_H
+
+#include "audio.h"
+#include "effect.hpp"
+#include <stdint.h>
+
+/// @brief Set to 0 to build without the reverb, its lines and its page
+#define REVERB_ENABLED 1
+
+/// @brief Length of the reverb lines relative to the Freeverb tuning, in
+/// percent. The lines take 25174 B at 100, in CCM
+#define REVERB_SIZE_PERCENT 100
+
+#if REVERB_ENABLED
+
+/// @brief Number of parallel comb filters and series allpass filters
+const int REVERB_COMBS = 8;
+const int REVERB_ALLPASSES = 4;
+
+/// @brief Samples processed per stage pass, bounds the stack scratch
+const int REVERB_CHUNK = 64;
+
+/// @brief Freeverb line lengths at 44.1 kHz, mutually prime-ish so that the
+/// echoes do not pile up
+constexpr int REVERB_COMB_TUNING[REVERB_COMBS] = {1116, 1188, 1277, 1356,
+                                                  1422, 1491, 1557, 1617};
+constexpr int REVERB_ALLPASS_TUNING[REVERB_ALLPASSES] = {556, 441, 341, 225};
+
+/// @brief Scaled length of a line
+constexpr int reverb_length(int tuning) {
+  return tuning * REVERB_SIZE_PERCENT / 100;
+}
+
+/// @brief Total number of samples of all lines
+constexpr int reverb_line_samples() {
+  int total = 0;
+  for (int i = 0; i < REVERB_COMBS; i++) {
+    total += reverb_length(REVERB_COMB_TUNING[i]);
+  }
+  for (int i = 0; i < REVERB_ALLPASSES; i++) {
+    total += reverb_length(REVERB_ALLPASS_TUNING[i]);
+  }
+  return total;
+}
+
+const int REVERB_LINE_SAMPLES = reverb_line_samples();
+
+/// @brief Comb and allpass lines, one pool
+extern int16_t reverb_lines[REVERB_LINE_SAMPLES];
+
+/// @brief Reverb parameters
+typedef struct reverb {
+  int16_t feedback; // comb feedback, Q15, sets the decay time
+  int16_t damping;  // comb lowpass coefficient, Q15, 0 = no damping
+  int16_t wet;      // level of the reverb in the output, Q15, 0 = off
+  int room_enc;
+  int damping_enc;
+  int mix_enc;
+} reverb_t;
+
+/// @brief Recompute the coefficients after a parameter change
+/// @param reverb the reverb parameters
+void reverb_update(reverb_t &reverb);
+
+/// @brief Lowpass feedback comb filter on a line of the pool
+class ReverbComb {
+public:
+  int16_t *_line;
+  int _length;
+  int _pos;
+  int32_t _store; // feedback lowpass state
+
+  /// @brief Add the comb output of a chunk to the accumulator
+  /// @param in the chunk input
+  /// @param acc the accumulator
+  /// @param n number of samples, at most REVERB_CHUNK
+  /// @param params the reverb parameters
+  void process(const int32_t *in, int32_t *acc, int n,
+               const reverb_t &params);
+};
+
+/// @brief Schroeder allpass filter, gain 1/2, on a line of the pool
+class ReverbAllpass {
+public:
+  int16_t *_line;
+  int _length;
+  int _pos;
+
+  /// @brief Filter a chunk in place
+  /// @param x the chunk
+  /// @param n number of samples, at most REVERB_CHUNK
+  void process(int32_t *x, int n);
+};
+
+/// @brief Mono Freeverb: parallel combs followed by series allpasses, in Q15
+/// Every stage runs over a whole chunk before the next one, so its line
+/// position and state stay in registers
+class Reverb {
+public:
+  ReverbComb _combs[REVERB_COMBS];
+  ReverbAllpass _allpasses[REVERB_ALLPASSES];
+  bool _active; // the lines hold audio of the current settings
+
+  /// @brief Default constructor, lays the lines out in the pool
+  Reverb();
+
+  /// @brief Add the reverb to a block
+  /// @param block the audio samples, modified in place
+  /// @param n number of samples
+  /// @param params the reverb parameters
+  /// @param ramp the master gain ramp if this is the last active stage
+  void process(int16_t *block, int n, const reverb_t &params,
+               gain_ramp_t *ramp = nullptr);
+
+private:
+  /// @brief Silence all lines and filter states
+  void clear();
+};
+
+#endif // REVERB_ENABLED
+
+#endif // REVERB_H
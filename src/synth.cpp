@@ -1,259 +1,462 @@
+#include "dsp.h"
+
 #include "synth.hpp"
 
+#include <array>
 #include <math.h>
 #include <stdint.h>
+#include <string.h>
+#include <utility>
 
 #include "audio.h"
+#include "governor.hpp"
 #include "leds.h"
+#include "memmap.h"
 #include "peripherals.h"
 #include "sine.hpp"
+#include "wavetable.hpp"
 
-void Synthesizer::initialize() {
-  // Initial values for oscillator/LPF
-  // to avoid setting encoders to uninitialized values
-  synth._osc1.wave_enc = 20;
-  synth._osc1.volume_enc = 40;
-  synth._osc1.freq_shift_enc = 24;
-
-  synth._osc2.wave_enc = 20;
-  synth._osc2.volume_enc = 40;
-  synth._osc2.freq_shift_enc = 24;
+DSP_TABLE const float SHIFT_FREQUENCIES[49] = {
+    0.250, 0.265, 0.281, 0.297, 0.315, 0.334, 0.354, 0.375, 0.397, 0.420,
+    0.445, 0.472, 0.500, 0.530, 0.561, 0.595, 0.630, 0.667, 0.707, 0.749,
+    0.794, 0.841, 0.891, 0.944, 1.000, 1.059, 1.122, 1.189, 1.260, 1.335,
+    1.414, 1.498, 1.587, 1.682, 1.782, 1.888, 2.000, 2.119, 2.245, 2.378,
+    2.520, 2.670, 2.828, 2.997, 3.175, 3.364, 3.564, 3.775, 4.000};
 
-  synth._lpf._cutoff_enc = 0;
-  synth._lpf._resonance_enc = 0;
-  synth._master_volume_enc = 40;
+/**
+ * Encoder parameters
+ */
+/// @brief Pages of the oscillator and effects encoders, numbered after the
+/// special effects pages
+typedef enum param_page {
+  MASTER_PAGE = VOICE_PAGE + 1,
+  OSC1_PAGE,
+  OSC2_PAGE,
+  LFO_PAGE,
+  ENVELOPE_PAGE
+} param_page_t;
+
+/// @brief Descriptor of a parameter set from an encoder
+/// The encoder position is stored with the parameters, the values the DSP
+/// uses are derived from it by the apply function
+typedef struct param {
+  uint8_t encoder;    // encoder the parameter is set from
+  int8_t page;        // page the encoder must be on, see encoder_page()
+  int16_t first;      // first encoder position
+  int16_t last;       // last encoder position, unless range is set
+  int (*range)();     // last position when it depends on other parameters
+  const float *curve; // value of each position, nullptr for the position
+  int (*get)();       // stored position
+  void (*put)(int position); // store a position, nullptr if apply does
+  void (*apply)(int position, float value); // update the derived values
+} param_t;
+
+/// @brief Getter and setter of a position stored in a field
+#define POSITION(field)                                                        \
+  [] { return (int)(field); }, [](int position) { field = position; }
+
+/// @brief Last position of the wave encoder, the last wavetable frame
+static int last_wave() {
+  return WAVETABLE_ENC_START + (wt_bank._count - 1) * WAVETABLE_ENC_PER_FRAME;
+}
 
-  // Done here since the OSC sw's "previous" value is Neutral
-  encoders[LPF_CUTOFF_ENC].set_state(synth._lpf._cutoff_enc);
-  encoders[OSC_VOLUME_ENC].set_state(synth._master_volume_enc);
-  encoders[LPF_RES_ENC].set_state(
-      synth._lpf._resonance_enc); // no frequency shift initially
+/// @brief Last position of the delay time, 10 ms steps or tempo divisions
+static int last_delay_time() {
+  return synth._delay.sync ? N_DELAY_DIVISIONS
+                           : DELAY_MAX_MS / DELAY_MS_PER_STEP;
+}
 
-  // Define the encoders callbacks
-  encoders[OSC_WAVE_ENC].set_callback(lpf_cutoff_wavetype_encoder_callback);
-  encoders[OSC_VOLUME_ENC].set_callback(volume_encoder_callback);
-  encoders[OSC_FREQ_ENC].set_callback(lpf_res_osc_freq_encoder_callback);
+static void apply_freq_shift(osc_t &osc, const char *name, float shift) {
+  osc.freq_shift = shift;
+  synth._dirty |= DIRTY_PITCH;
+  printuln("[Frequency Shifter] %s: %f Hz", name, (double)shift);
+}
 
-  encoders[LFO_FREQ_ENC].set_callback(lfo_freq_amp_mod_attack_callback);
-  encoders[LFO_AMP_ENC].set_callback(lfo_amp_amp_mod_sustain_callback);
-  encoders[AMP_REL_ENC].set_callback(amp_mod_release_callback);
+/// @brief Set an oscillator's wave from the wave encoder position
+/// Below WAVETABLE_ENC_START the encoder selects one of the fixed waves, above
+/// it scans the wavetable bank
+static void apply_wave(osc_t &osc, const char *name, int position) {
+  if (position < WAVETABLE_ENC_START) {
+    osc.wave = static_cast<wavetype_t>(position >> 3);
+  } else {
+    osc.wave = wavetable;
+    osc.wt_position = (position - WAVETABLE_ENC_START) *
+                      WT_POSITION_PER_FRAME / WAVETABLE_ENC_PER_FRAME;
+  }
+  printuln("[Waveform Select] %s: %d, position %d", name, osc.wave,
+           osc.wt_position);
+}
 
-  // Define the switches callbacks and call them once
-  switches[OSC_SEL_SW]._callback = oscillator_selection_switch_callback;
-  switches[OSC_SEL_SW].update();
-  switches[EFFECTS_TARGET_SW]._callback = lfo_target_switch_callback;
-  switches[EFFECTS_TARGET_SW].update();
-  switches[EFFECTS_CONF_SW]._callback = effects_configuration_switch_callback;
-  switches[EFFECTS_CONF_SW].update();
-  switches[EFFECTS_SEL_SW]._callback = effects_selection_switch_callback;
-  switches[EFFECTS_SEL_SW].update();
+static void apply_volume(osc_t &osc, const char *name, int position) {
+  osc.volume = position * position * 16;
+  osc.enabled = osc.volume != 0;
+  printuln("[Volume Encoder]: %s: %d", name, osc.volume);
+}
 
-  // Set initial values of oscillator encoders in preparation for callback
-  switch (switches[OSC_SEL_SW]._previous) {
-  case Up:
-    encoders[OSC_WAVE_ENC].set_state(synth._osc1.wave_enc);
-    encoders[OSC_VOLUME_ENC].set_state(synth._osc1.volume_enc);
-    encoders[OSC_FREQ_ENC].set_state(
-        synth._osc1.freq_shift_enc); // no frequency shift initially
-    break;
-  case Down:
-    encoders[OSC_WAVE_ENC].set_state(synth._osc2.wave_enc);
-    encoders[OSC_VOLUME_ENC].set_state(synth._osc2.volume_enc);
-    encoders[OSC_FREQ_ENC].set_state(
-        synth._osc2.freq_shift_enc); // no frequency shift initially
-    break;
-  case Neutral:
-    encoders[LPF_CUTOFF_ENC].set_state(synth._lpf._cutoff_enc);
-    encoders[OSC_VOLUME_ENC].set_state(synth._master_volume_enc);
-    encoders[LPF_RES_ENC].set_state(synth._lpf._resonance_enc);
-    break;
+/// @brief Convert an envelope time encoder position to a level step
+/// @param state encoder position, the time is state^2 ms
+/// @return the level change per control period
+static float envelope_step(int state) {
+  if (state == 0) {
+    return 1.f;
   }
+  return CONTROL_PERIOD / (state * state / 1000.f * SAMPLE_FREQUENCY);
+}
 
-  oscillator_selection_switch_callback(switches[OSC_SEL_SW]);
-  lfo_target_switch_callback(switches[EFFECTS_TARGET_SW]);
-  effects_configuration_switch_callback(switches[EFFECTS_CONF_SW]);
-  effects_selection_switch_callback(switches[EFFECTS_SEL_SW]);
+static const char *const LFO_SHAPE_NAMES[N_LFO_SHAPES] = {
+    "sine", "triangle", "square", "saw", "sample and hold"};
 
-  printuln("Synthesizer initialization finished!");
+static void apply_delay(int, float) {
+  delay_update(synth._delay);
+  printuln("[Delay] %d samples (%s), feedback %d/32, mix %d/32",
+           synth._delay.length, delay_time_name(synth._delay),
+           synth._delay.feedback_enc, synth._delay.mix_enc);
 }
 
-/**
- * Oscillator and LPF callbacks
- */
-void oscillator_selection_switch_callback(ThreePosSwitch &sw) {
-  // Save the previous state
-  switch (sw._previous) {
-  case Neutral:
-    synth._master_volume_enc = encoders[OSC_VOLUME_ENC].get_state();
-    synth._lpf._cutoff_freq = encoders[LPF_CUTOFF_ENC].get_state();
-    synth._lpf._resonance_freq = encoders[LPF_RES_ENC].get_state();
-    break;
-  case Up:
-    synth._osc1.volume_enc = encoders[OSC_VOLUME_ENC].get_state();
-    synth._osc1.wave_enc = encoders[OSC_WAVE_ENC].get_state();
-    synth._osc1.freq_shift_enc = encoders[OSC_FREQ_ENC].get_state();
-    break;
-  case Down:
-    synth._osc2.volume_enc = encoders[OSC_VOLUME_ENC].get_state();
-    synth._osc2.wave_enc = encoders[OSC_WAVE_ENC].get_state();
-    synth._osc2.freq_shift_enc = encoders[OSC_FREQ_ENC].get_state();
-    break;
+static void apply_delay_sync(int, float) {
+  delay_update(synth._delay);
+  printuln("[Delay] %d BPM, sync %s, damping %d/32: %d samples (%s)",
+           synth._delay.bpm, synth._delay.sync ? "on" : "off",
+           synth._delay.damping_enc, synth._delay.length,
+           delay_time_name(synth._delay));
+}
+
+static void apply_shaper(int, float) {
+  shaper_update(synth._shaper);
+  printuln("[Distortion] Drive %d/32, level %d/32, %dx oversampling",
+           synth._shaper.drive_enc, synth._shaper.level_enc,
+           synth._shaper.factor);
+}
+
+static void apply_chorus(int, float) {
+  chorus_update(synth._chorus);
+  printuln("[Chorus] Rate %f Hz, depth %d/32, mix %d/32",
+           (double)synth._chorus.rate, synth._chorus.depth_enc,
+           synth._chorus.mix_enc);
+}
+
+static void apply_chorus_shape(int, float) {
+  chorus_update(synth._chorus);
+  printuln("[Chorus] Delay %f samples, feedback %d/32, %s",
+           (double)synth._chorus.center, synth._chorus.feedback_enc,
+           LFO_SHAPE_NAMES[synth._chorus.shape]);
+}
+
+#if REVERB_ENABLED
+static void apply_reverb(int, float) {
+  reverb_update(synth._reverb);
+  printuln("[Reverb] Room %d/32, damping %d/32, mix %d/32",
+           synth._reverb.room_enc, synth._reverb.damping_enc,
+           synth._reverb.mix_enc);
+}
+#endif
+
+/// @brief Every parameter set from the encoders
+static const param_t PARAMS[] = {
+    // Master page: LPF, applied on the next control tick, and master gain
+    {LPF_RES_ENC, MASTER_PAGE, 0, 47, nullptr, nullptr,
+     POSITION(synth._lpf._resonance_enc),
+     [](int position, float) {
+       synth._dirty |= DIRTY_FILTER;
+       printuln("[LPF Resonance] Q: %f",
+                (double)(BUTTERWORTH_Q *
+                         exp2f((float)position / RESONANCE_ENC_PER_OCTAVE)));
+     }},
+    {LPF_CUTOFF_ENC, MASTER_PAGE, 0, 95, nullptr, CUTOFF_FREQUENCIES_96,
+     POSITION(synth._lpf._cutoff_enc),
+     [](int, float cutoff) {
+       synth._dirty |= DIRTY_FILTER;
+       printuln("[LPF Cutoff Frequency] %f Hz", (double)cutoff);
+     }},
+    {OSC_VOLUME_ENC, MASTER_PAGE, 0, MASTER_VOLUME_ENC_MAX, nullptr, nullptr,
+     POSITION(synth._master_volume_enc),
+     [](int position, float) {
+       // Ramped at the next block, no codec write
+       synth._master_gain = get_master_gain(position);
+       printuln("[Volume Encoder]: MASTER: %f dB",
+                (double)((position - MASTER_VOLUME_ENC_MAX) *
+                         MASTER_DB_PER_STEP));
+     }},
+
+    // Oscillator pages
+    {OSC_FREQ_ENC, OSC1_PAGE, 0, 47, nullptr, SHIFT_FREQUENCIES,
+     POSITION(synth._osc1.freq_shift_enc),
+     [](int, float shift) { apply_freq_shift(synth._osc1, "OSC1", shift); }},
+    {OSC_WAVE_ENC, OSC1_PAGE, 0, 0, last_wave, nullptr,
+     POSITION(synth._osc1.wave_enc),
+     [](int position, float) { apply_wave(synth._osc1, "OSC1", position); }},
+    {OSC_VOLUME_ENC, OSC1_PAGE, 0, 50, nullptr, nullptr,
+     POSITION(synth._osc1.volume_enc),
+     [](int position, float) { apply_volume(synth._osc1, "OSC1", position); }},
+    {OSC_FREQ_ENC, OSC2_PAGE, 0, 47, nullptr, SHIFT_FREQUENCIES,
+     POSITION(synth._osc2.freq_shift_enc),
+     [](int, float shift) { apply_freq_shift(synth._osc2, "OSC2", shift); }},
+    {OSC_WAVE_ENC, OSC2_PAGE, 0, 0, last_wave, nullptr,
+     POSITION(synth._osc2.wave_enc),
+     [](int position, float) { apply_wave(synth._osc2, "OSC2", position); }},
+    {OSC_VOLUME_ENC, OSC2_PAGE, 0, 50, nullptr, nullptr,
+     POSITION(synth._osc2.volume_enc),
+     [](int position, float) { apply_volume(synth._osc2, "OSC2", position); }},
+
+    // LFO page, the LFO of the current target
+    {LFO_FREQ_ENC, LFO_PAGE, 0, 47, nullptr, LFO_FREQUENCIES,
+     POSITION(synth._lfos[synth._lfo_target]._frequency_enc),
+     [](int, float frequency) {
+       synth._lfos[synth._lfo_target].set_frequency(frequency);
+       printuln("[LFO Frequency] LFO #%d: %f", synth._lfo_target,
+                (double)frequency);
+     }},
+    {LFO_AMP_ENC, LFO_PAGE, 0, 95, nullptr, LFO_AMPLITUDES,
+     POSITION(synth._lfos[synth._lfo_target]._amplitude_enc),
+     [](int, float amplitude) {
+       // The LFO's routes are only active while its amplitude is not 0
+       synth._lfos[synth._lfo_target].set_amplitude(amplitude);
+       synth._matrix._dirty = true;
+       printuln("[LFO Amplitude] LFO #%d: %f", synth._lfo_target,
+                (double)amplitude);
+     }},
+
+    // Amplitude envelope page
+    {AMP_MOD_ATT_ENC, ENVELOPE_PAGE, 0, 47, nullptr, nullptr,
+     POSITION(synth._envelope.attack_enc),
+     [](int position, float) {
+       synth._envelope.attack_step = envelope_step(position);
+       printuln("[AM Attack] %d ms", position * position);
+     }},
+    {AMP_MOD_SUS_ENC, ENVELOPE_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._envelope.sustain_enc),
+     [](int position, float) {
+       synth._envelope.sustain = position / 32.f;
+       printuln("[AM Sustain] %d/32", position);
+     }},
+    {AMP_REL_ENC, ENVELOPE_PAGE, 0, 47, nullptr, nullptr,
+     POSITION(synth._envelope.release_enc),
+     [](int position, float) {
+       synth._envelope.release_step = envelope_step(position);
+       printuln("[AM Release] %d ms", position * position);
+     }},
+
+    // Unison page
+    {FX_PARAM0_ENC, UNISON_PAGE, 0, (int16_t)UNISON_MAX_DETUNE, nullptr,
+     nullptr, POSITION(synth._unison.detune_enc),
+     [](int position, float detune) {
+       synth._unison.detune = detune;
+       unison_update(synth._unison);
+       printuln("[Unison] Detune: %d cents", position);
+     }},
+    {FX_PARAM1_ENC, UNISON_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._unison.mix_enc),
+     [](int position, float) {
+       synth._unison.mix = position / 32.f;
+       unison_update(synth._unison);
+       printuln("[Unison] Side copies level: %d/32", position);
+     }},
+    {FX_PARAM2_ENC, UNISON_PAGE, 0, UNISON_MAX_VOICES / 2, nullptr, nullptr,
+     POSITION(synth._unison.voices_enc),
+     [](int position, float) {
+       synth._unison.voices = position == 0 ? 1 : 2 * position;
+       unison_update(synth._unison);
+       printuln("[Unison] Copies: %d", synth._unison.voices);
+     }},
+
+    // Pitch page
+    {FX_PARAM0_ENC, PITCH_PAGE, 0, 47, nullptr, nullptr,
+     POSITION(synth._pitch.glide_enc),
+     [](int position, float) {
+       // Quadratic curve, up to about 2 s
+       synth._pitch.glide_time = position * position / 1000.f;
+       if (position == 0) {
+         synth._pitch.glide_rate = 1.f;
+       } else {
+         synth._pitch.glide_rate =
+             1.f - expf(-CONTROL_PERIOD /
+                       (synth._pitch.glide_time * SAMPLE_FREQUENCY));
+       }
+       printuln("[Glide] Time: %d ms", position * position);
+     }},
+    {FX_PARAM1_ENC, PITCH_PAGE, -8 * PITCH_BEND_RANGE, 8 * PITCH_BEND_RANGE,
+     nullptr, nullptr, POSITION(synth._pitch.bend_enc),
+     [](int position, float) {
+       // 1/8 semitone per step
+       synth._pitch.bend = position / 8.f;
+       synth._pitch.bend_ratio = exp2f(synth._pitch.bend / 12.f);
+       synth._dirty |= DIRTY_PITCH;
+       printuln("[Pitch Bend] %d/8 semitones", position);
+     }},
+    // The octave shift is also changed from the keyboard
+    {FX_PARAM2_ENC, PITCH_PAGE, MIN_OCTAVE_SHIFT, MAX_OCTAVE_SHIFT, nullptr,
+     nullptr, [] { return (int)keyboard_octave; }, nullptr,
+     [](int position, float) {
+       Key::shift_octave(position - keyboard_octave);
+       printuln("[Keyboard] Octave shift: %d", keyboard_octave);
+     }},
+
+    // Delay pages
+    {FX_PARAM0_ENC, DELAY_PAGE, 0, 0, last_delay_time, nullptr,
+     POSITION(synth._delay.time_enc), apply_delay},
+    {FX_PARAM1_ENC, DELAY_PAGE, 0, 30, nullptr, nullptr,
+     POSITION(synth._delay.feedback_enc), apply_delay},
+    {FX_PARAM2_ENC, DELAY_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._delay.mix_enc), apply_delay},
+    {FX_PARAM0_ENC, DELAY_SYNC_PAGE, DELAY_MIN_BPM, DELAY_MAX_BPM, nullptr,
+     nullptr, POSITION(synth._delay.bpm), apply_delay_sync},
+    {FX_PARAM1_ENC, DELAY_SYNC_PAGE, 0, 1, nullptr, nullptr,
+     POSITION(synth._delay.sync), apply_delay_sync},
+    {FX_PARAM2_ENC, DELAY_SYNC_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._delay.damping_enc), apply_delay_sync},
+
+    // Distortion page, 1x, 2x or 4x oversampling
+    {FX_PARAM0_ENC, SHAPER_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._shaper.drive_enc), apply_shaper},
+    {FX_PARAM1_ENC, SHAPER_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._shaper.level_enc), apply_shaper},
+    {FX_PARAM2_ENC, SHAPER_PAGE, 0, 2, nullptr, nullptr,
+     POSITION(synth._shaper.factor_enc), apply_shaper},
+
+    // Voice page
+    {FX_PARAM0_ENC, VOICE_PAGE, 0, 1, nullptr, nullptr,
+     [] { return (int)(synth._oversampling > 1); }, nullptr,
+     [](int position, float) {
+       synth.set_oversampling(position ? QUALITY_OVERSAMPLING : 1);
+       // A choice of the user is not undone by the governor
+       governor._oversampling_dropped = false;
+       printuln("[Voice] Core at %dx", synth._oversampling);
+     }},
+    {FX_PARAM1_ENC, VOICE_PAGE, 0, FM_INDEX_ENC_MAX, nullptr, nullptr,
+     POSITION(synth._fm.index_enc),
+     [](int position, float) {
+       // 0 = plain mixing
+       synth._fm.index = position * FM_INDEX_PER_STEP;
+       printuln("[Voice] FM index %d/%d", position, FM_INDEX_ENC_MAX);
+     }},
+
+    // Chorus pages, 0.5 ms center delay steps, negative feedback for the
+    // hollow flanger sound
+    {FX_PARAM0_ENC, CHORUS_PAGE, 0, 47, nullptr, nullptr,
+     POSITION(synth._chorus.rate_enc), apply_chorus},
+    {FX_PARAM1_ENC, CHORUS_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._chorus.depth_enc), apply_chorus},
+    {FX_PARAM2_ENC, CHORUS_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._chorus.mix_enc), apply_chorus},
+    {FX_PARAM0_ENC, CHORUS_SHAPE_PAGE, 0, CHORUS_MAX_DELAY_ENC - 1, nullptr,
+     nullptr, POSITION(synth._chorus.delay_enc), apply_chorus_shape},
+    {FX_PARAM1_ENC, CHORUS_SHAPE_PAGE, -28, 28, nullptr, nullptr,
+     POSITION(synth._chorus.feedback_enc), apply_chorus_shape},
+    {FX_PARAM2_ENC, CHORUS_SHAPE_PAGE, 0, N_LFO_SHAPES - 1, nullptr, nullptr,
+     POSITION(synth._chorus.shape), apply_chorus_shape},
+
+#if REVERB_ENABLED
+    // Reverb page
+    {FX_PARAM0_ENC, REVERB_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._reverb.room_enc), apply_reverb},
+    {FX_PARAM1_ENC, REVERB_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._reverb.damping_enc), apply_reverb},
+    {FX_PARAM2_ENC, REVERB_PAGE, 0, 32, nullptr, nullptr,
+     POSITION(synth._reverb.mix_enc), apply_reverb},
+#endif
+};
+
+static const int N_PARAMS = sizeof(PARAMS) / sizeof(PARAMS[0]);
+
+/// @brief Page an encoder is on, selected by the switches
+/// @param encoder the encoder
+/// @return the page, NO_PAGE if the encoder sets nothing
+static int encoder_page(uint8_t encoder) {
+  if (encoder <= OSC_VOLUME_ENC) {
+    switch (switches[OSC_SEL_SW]._current_state) {
+    case Up:
+      return OSC1_PAGE;
+    case Down:
+      return OSC2_PAGE;
+    default:
+      return MASTER_PAGE;
+    }
   }
 
-  // Load the new state
-  switch (sw._current_state) {
-  case Neutral:
-    encoders[OSC_VOLUME_ENC].set_state(synth._master_volume_enc);
-    encoders[LPF_CUTOFF_ENC].set_state(synth._lpf._cutoff_freq);
-    encoders[LPF_RES_ENC].set_state(synth._lpf._resonance_freq);
-    break;
+  switch (switches[EFFECTS_SEL_SW]._current_state) {
   case Up:
-    printuln("SW UP!");
-    synth._osc1.enabled = true;
-    encoders[OSC_VOLUME_ENC].set_state(synth._osc1.volume_enc);
-    encoders[OSC_WAVE_ENC].set_state(synth._osc1.wave_enc);
-    encoders[OSC_FREQ_ENC].set_state(synth._osc1.freq_shift_enc);
-    break;
+    if (synth._lfo_target == NONE) {
+      return NO_PAGE;
+    }
+    return LFO_PAGE;
   case Down:
-    printuln("SW DOWN!");
-    synth._osc2.enabled = true;
-    encoders[OSC_VOLUME_ENC].set_state(synth._osc2.volume_enc);
-    encoders[OSC_WAVE_ENC].set_state(synth._osc2.wave_enc);
-    encoders[OSC_FREQ_ENC].set_state(synth._osc2.freq_shift_enc);
-    break;
+    return ENVELOPE_PAGE;
+  default:
+    return get_effect_page(switches[EFFECTS_CONF_SW]._current_state,
+                           switches[EFFECTS_TARGET_SW]._current_state);
   }
+}
 
-  // May need to also update the LFO target based on new value of this switch
-  ThreeWaySwitchState lfo_target_sw =
-      switches[EFFECTS_TARGET_SW]._current_state;
-  ThreeWaySwitchState lfo_amp_mod_sel_sw =
-      switches[EFFECTS_SEL_SW]._current_state;
-
-  // Determine old and new values for the LFO target
-  lfo_target_t prev_lfo_target = synth._lfo_target;
-  lfo_target_t new_lfo_target =
-      get_lfo_target(sw._current_state, lfo_target_sw);
-
-  // If there was a change in target, something either needs to be saved,
-  // loaded, or both
-  if (new_lfo_target != prev_lfo_target) {
-    // In any case, point to the new LFO target
-    synth._lfo_target = new_lfo_target;
-    printuln("[OSC Select Switch] LFO Target Changed - Old: %d, New: %d",
-             prev_lfo_target, new_lfo_target);
-
-    // There was a previously valid LFO target, so save the state
-    if (prev_lfo_target != NONE) {
-      // Save off previous encoder values
-      synth._lfos[prev_lfo_target]._frequency_enc =
-          encoders[LFO_FREQ_ENC].get_state();
-      synth._lfos[prev_lfo_target]._amplitude_enc =
-          encoders[LFO_AMP_ENC].get_state();
-    }
-
-    // There is a new valid LFO target, so load the state
-    if (new_lfo_target != NONE) {
-      // Load new encoder values
-      encoders[LFO_FREQ_ENC].set_state(
-          synth._lfos[new_lfo_target]._frequency_enc);
-      encoders[LFO_AMP_ENC].set_state(
-          synth._lfos[new_lfo_target]._amplitude_enc);
-
-      // Call the LFO encoders' callbacks
-      encoders[LFO_FREQ_ENC]._callback(encoders[LFO_FREQ_ENC]);
-      encoders[LFO_AMP_ENC]._callback(encoders[LFO_AMP_ENC]);
+/// @brief Find the parameter an encoder sets on a page
+/// @param encoder the encoder
+/// @param page the page
+/// @return the parameter, nullptr if there is none
+static const param_t *find_param(uint8_t encoder, int page) {
+  for (int i = 0; i < N_PARAMS; i++) {
+    if (PARAMS[i].encoder == encoder && PARAMS[i].page == page) {
+      return &PARAMS[i];
     }
   }
-
-  // Call the encoder's callbacks
-  encoders[OSC_VOLUME_ENC]._callback(encoders[OSC_VOLUME_ENC]);
-  encoders[OSC_WAVE_ENC]._callback(encoders[OSC_WAVE_ENC]);
-  encoders[OSC_FREQ_ENC]._callback(encoders[OSC_FREQ_ENC]);
+  return nullptr;
 }
 
-void lpf_res_osc_freq_encoder_callback(RotaryEncoder &encoder) {
-  int state = encoder.get_state();
-
-  switch (switches[0]._current_state) {
-  case Up: // configure OSC 1 frequency
-    // Clamp encoder value
-    encoder.set_state_clamped(state, 0, 47);
-    state = encoder.get_state();
-
-    synth._osc1.freq_shift = SHIFT_FREQUENCIES[state];
-    printuln("[Frequency Shifter] OSC1: %f Hz", SHIFT_FREQUENCIES[state]);
-    break;
-  case Down: // configure OSC 2 frequency
-    // Clamp encoder value
-    encoder.set_state_clamped(state, 0, 47);
-    state = encoder.get_state();
-
-    synth._osc2.freq_shift = SHIFT_FREQUENCIES[state];
-    printuln("[Frequency Shifter] OSC2: %f Hz", SHIFT_FREQUENCIES[state]);
-    break;
-  case Neutral: // configure LPF resonance frequency
-    printuln("[LPF Resonance Frequency] callback not implemented");
-    synth._lpf.set_resonance_freq(state);
-    break;
+/// @brief Store a parameter position and update the values derived from it
+/// @param param the parameter
+/// @param position the position, within the parameter range
+static void apply_param(const param_t &param, int position) {
+  if (param.put != nullptr) {
+    param.put(position);
   }
+  float value = param.curve != nullptr ? param.curve[position - param.first]
+                                       : (float)position;
+  param.apply(position, value);
 }
 
-void lpf_cutoff_wavetype_encoder_callback(RotaryEncoder &encoder) {
-  int state = encoder.get_state();
-  switch (switches[0]._current_state) {
-  case Up:
-    synth._osc1.wave = static_cast<wavetype_t>((state >> 3) & 0x03);
-    printuln("[Waveform Select] OSC1: %d", synth._osc1.wave);
-    break;
-  case Down:
-    synth._osc2.wave = static_cast<wavetype_t>((state >> 3) & 0x03);
-    printuln("[Waveform Select] OSC2: %d", synth._osc2.wave);
-    break;
-  case Neutral:
-    // encoder.set_state_clamped(state, 0, 96);
-    // state = encoder.get_state();
-
-    // synth._lpf.set_cutoff_freq(CUTOFF_FREQUENCIES_96[state]);
-    printuln("[LPF Cutoff Frequency] callback not implemented");
+/// @brief Update the values derived from the parameters of a page
+/// @param page the page
+static void apply_page(int page) {
+  for (int i = 0; i < N_PARAMS; i++) {
+    if (PARAMS[i].page == page) {
+      apply_param(PARAMS[i], PARAMS[i].get());
+    }
+  }
+}
 
-    break;
+/// @brief Point the encoders at the parameters of a page
+/// The positions are stored on every encoder step, nothing is saved from the
+/// page the encoders leave
+/// @param page the page
+static void load_page(int page) {
+  for (int i = 0; i < N_PARAMS; i++) {
+    if (PARAMS[i].page == page) {
+      encoders[PARAMS[i].encoder].set_state(PARAMS[i].get());
+    }
   }
 }
 
-void volume_encoder_callback(RotaryEncoder &encoder) {
-  int state = encoder.get_state();
+void param_encoder_callback(RotaryEncoder &encoder) {
+  const param_t *param = find_param(encoder._id, encoder_page(encoder._id));
+  if (param == nullptr) {
+    printuln("[Encoder %d] No parameter on this page", encoder._id);
+    return;
+  }
 
-  encoder.set_state_clamped(state, 0, 50);
+  int last = param->range != nullptr ? param->range() : param->last;
+  encoder.set_state_clamped(encoder.get_state(), param->first, last);
+  apply_param(*param, encoder.get_state());
+}
 
-  state = encoder.get_state();
-  uint16_t volume = state * state * 16;
-  uint8_t master_volume = 27 + state * 2;
+void load_encoders() {
+  load_page(encoder_page(OSC_VOLUME_ENC));
+  load_page(encoder_page(AMP_REL_ENC));
+}
 
-  // Update the volume
-  switch (switches[0]._current_state) {
-  case Up:
-    synth._osc1.volume = volume;
-    if (volume == 0)
-      synth._osc1.enabled = false;
-    else
-      synth._osc1.enabled = true;
-    printuln("[Volume Encoder]: OSC1: %d", volume);
-    break;
-  case Down:
-    synth._osc2.volume = volume;
-    if (volume == 0)
-      synth._osc2.enabled = false;
-    else
-      synth._osc2.enabled = true;
-    printuln("[Volume Encoder]: OSC2: %d", volume);
-    break;
-  case Neutral:
-    setVolume(master_volume);
-    printuln("[Volume Encoder]: MASTER: %d", master_volume);
-    break;
-  default:
-    break;
+float get_master_gain(int volume_enc) {
+  if (volume_enc <= 0) {
+    return 0.;
   }
+  return powf(10.f,
+              (volume_enc - MASTER_VOLUME_ENC_MAX) * MASTER_DB_PER_STEP / 20.f);
 }
 
 lfo_target_t get_lfo_target(ThreeWaySwitchState osc_sw,
@@ -266,14 +469,14 @@ lfo_target_t get_lfo_target(ThreeWaySwitchState osc_sw,
     } else if (lfo_target_sw == Down) {
       return OSC1_AMP;
     } else
-      return NONE;
+      return OSC1_WAVE;
   case Down:
     if (lfo_target_sw == Up) {
       return OSC2_FREQ;
     } else if (lfo_target_sw == Down) {
       return OSC2_AMP;
     } else
-      return NONE;
+      return OSC2_WAVE;
   case Neutral:
     if (lfo_target_sw == Neutral) {
       return LPF_CUTOFF;
@@ -282,250 +485,771 @@ lfo_target_t get_lfo_target(ThreeWaySwitchState osc_sw,
   return NONE;
 }
 
+effect_page_t get_effect_page(ThreeWaySwitchState conf_sw,
+                              ThreeWaySwitchState target_sw) {
+  switch (conf_sw) {
+  case Up:
+    if (target_sw == Up) {
+      return UNISON_PAGE;
+    } else if (target_sw == Neutral) {
+      return PITCH_PAGE;
+    }
+    return DELAY_PAGE;
+  case Neutral:
+#if REVERB_ENABLED
+    if (target_sw == Up) {
+      return REVERB_PAGE;
+    }
+#endif
+    if (target_sw == Neutral) {
+      return CHORUS_PAGE;
+    } else if (target_sw == Down) {
+      return CHORUS_SHAPE_PAGE;
+    }
+    return NO_PAGE;
+  case Down:
+    if (target_sw == Up) {
+      return DELAY_SYNC_PAGE;
+    } else if (target_sw == Neutral) {
+      return SHAPER_PAGE;
+    }
+    return VOICE_PAGE;
+  default:
+    return NO_PAGE;
+  }
+}
+
 /**
- * LFO and Amplitude Modulator target configuration callbacks
+ * Switch callbacks, they only point the encoders at other parameters
  */
-void lfo_target_switch_callback(ThreePosSwitch &sw) {
-  // Obtain previous and new LFO targets
-  lfo_target_t prev_lfo_target = synth._lfo_target;
-  lfo_target_t new_lfo_target =
-      get_lfo_target(switches[OSC_SEL_SW]._current_state, sw._current_state);
-
-  // Save encoders values if they were linked to LFO
-  if (prev_lfo_target != NONE) {
-    synth._lfos[prev_lfo_target]._frequency_enc =
-        encoders[LFO_FREQ_ENC].get_state();
-    synth._lfos[prev_lfo_target]._amplitude_enc =
-        encoders[LFO_AMP_ENC].get_state();
+/// @brief Follow the LFO target selected by the switches
+/// @param source the switch, for the log
+static void update_lfo_target(const char *source) {
+  lfo_target_t target =
+      get_lfo_target(switches[OSC_SEL_SW]._current_state,
+                     switches[EFFECTS_TARGET_SW]._current_state);
+  if (target != synth._lfo_target) {
+    printuln("[%s] LFO Target Changed - Old: %d, New: %d", source,
+             synth._lfo_target, target);
+    synth._lfo_target = target;
   }
+}
 
-  // Load new encoder values if a valid LFO target has been selected by switches
-  if (new_lfo_target != NONE) {
-    encoders[LFO_FREQ_ENC].set_state(
-        synth._lfos[new_lfo_target]._frequency_enc);
-    encoders[LFO_AMP_ENC].set_state(synth._lfos[new_lfo_target]._amplitude_enc);
+void oscillator_selection_switch_callback(ThreePosSwitch &sw) {
+  // A selected oscillator sounds unless its volume is 0
+  switch (sw._current_state) {
+  case Neutral:
+    break;
+  case Up:
+    printuln("SW UP!");
+    synth._osc1.enabled = synth._osc1.volume != 0;
+    break;
+  case Down:
+    printuln("SW DOWN!");
+    synth._osc2.enabled = synth._osc2.volume != 0;
+    break;
   }
 
-  // Unconditionally update LFO target to ensure setting to NONE
-  synth._lfo_target = new_lfo_target;
-  printuln("[LFO Target Switch] LFO Target Changed - Old: %d, New: %d",
-           prev_lfo_target, new_lfo_target);
+  // The oscillator selection is also part of the LFO target
+  update_lfo_target("OSC Select Switch");
+  load_encoders();
+}
+
+void lfo_target_switch_callback(ThreePosSwitch &sw) {
+  // On the special effects pages, this switch selects the page
+  update_lfo_target("LFO Target Switch");
+  load_page(encoder_page(FX_PARAM0_ENC));
 }
 
 void effects_configuration_switch_callback(ThreePosSwitch &sw) {
+  if (switches[EFFECTS_SEL_SW]._current_state == Neutral) {
+    load_page(encoder_page(FX_PARAM0_ENC));
+    return;
+  }
+
+  if (switches[EFFECTS_SEL_SW]._current_state == Up) {
+    // Up/Down step through the waveforms of the targeted LFO
+    if (synth._lfo_target == NONE || sw._current_state == sw._previous ||
+        sw._current_state == Neutral) {
+      return;
+    }
+
+    LFO &lfo = synth._lfos[synth._lfo_target];
+    int shape = (lfo._shape + N_LFO_SHAPES + sw._current_state) % N_LFO_SHAPES;
+    lfo.set_shape((lfo_shape_t)shape);
+    printuln("[LFO Shape] LFO #%d: %s", synth._lfo_target,
+             LFO_SHAPE_NAMES[shape]);
+    return;
+  }
+
   printuln("Effects configuration switch not implemented yet.");
 }
 
 void effects_selection_switch_callback(ThreePosSwitch &sw) {
-  // Load the new state
   switch (sw._current_state) {
   case Up:
     printuln("[SW3] Configuring LFO");
     break;
   case Down:
-    printuln("[SW3] Configuring amplitude modulator (not implemented)");
+    printuln("[SW3] Configuring amplitude envelope");
     break;
   case Neutral:
-    printuln("[SW3] Configuring special effects (not implemented)");
+    printuln("[SW3] Configuring special effects");
     break;
   }
 
-  // May need to also update the LFO target based on new value of this switch
-  ThreeWaySwitchState lfo_target_sw =
-      switches[EFFECTS_TARGET_SW]._current_state;
-  ThreeWaySwitchState osc_sel_sw = switches[OSC_SEL_SW]._current_state;
-
-  // Determine old and new values for the LFO target
-  lfo_target_t prev_lfo_target = synth._lfo_target;
-  lfo_target_t new_lfo_target = get_lfo_target(osc_sel_sw, lfo_target_sw);
-
-  // If there was a change in target, something either needs to be saved,
-  // loaded, or both
-  if (new_lfo_target != prev_lfo_target) {
-    // In any case, point to the new LFO target
-    synth._lfo_target = new_lfo_target;
-    printuln("[SW3] LFO Target Changed - Old: %d, New: %d", prev_lfo_target,
-             new_lfo_target);
-    // There was a previously valid LFO target, so save the state
-    if (prev_lfo_target != NONE) {
-      // Save off previous encoder values
-      synth._lfos[prev_lfo_target]._frequency_enc =
-          encoders[LFO_FREQ_ENC].get_state();
-      synth._lfos[prev_lfo_target]._amplitude_enc =
-          encoders[LFO_FREQ_ENC].get_state();
-    }
-
-    // There is a new valid LFO target, so load the state
-    if (new_lfo_target != NONE) {
-      // Load new encoder values
-      encoders[LFO_FREQ_ENC].set_state(
-          synth._lfos[new_lfo_target]._frequency_enc);
-      encoders[LFO_AMP_ENC].set_state(
-          synth._lfos[new_lfo_target]._amplitude_enc);
-
-      // Call the LFO encoders' callbacks
-      encoders[LFO_FREQ_ENC]._callback(encoders[LFO_FREQ_ENC]);
-      encoders[LFO_AMP_ENC]._callback(encoders[LFO_AMP_ENC]);
-    }
-  }
+  // The LFO, amplitude envelope and special effects pages share encoders
+  update_lfo_target("SW3");
+  load_page(encoder_page(FX_PARAM0_ENC));
 }
 
-/**
- * LFO and Amplitude Modulator parameter callbacks
- */
-void lfo_freq_amp_mod_attack_callback(RotaryEncoder &encoder) {
-  int state = encoder.get_state();
+void Synthesizer::initialize() {
+  wt_bank.initialize();
+  shaper_init();
 
-  // Determine whether LFO frequency or amplitude modulator attack
-  // needs to be modified
-  switch (switches[EFFECTS_SEL_SW]._current_state) {
-  case Up: // LFO FREQUENCY
-    encoder.set_state_clamped(state, 0, 47);
-
-    // // Determine which LFO frequency to modify
-    synth._lfos[synth._lfo_target].set_frequency(
-        LFO_FREQUENCIES[encoder.get_state()]);
-    printuln("[LFO Frequency] LFO #%d: %f", synth._lfo_target,
-             synth._lfos[synth._lfo_target]._frequency);
-    break;
-  case Down: // AMPLITUDE MODULATOR ATTACK
-    printuln("[AM Attack] callback not implemented");
-    break;
-  case Neutral: // SPECIAL EFFECT 0
-    printuln("[Special Effect] callback not implemented");
-    break;
-  }
-}
+  // Initial values for oscillator/LPF
+  // to avoid setting encoders to uninitialized values
+  synth._osc1.wave_enc = 20;
+  synth._osc1.volume_enc = 40;
+  synth._osc1.freq_shift_enc = 24;
+
+  synth._osc2.wave_enc = 20;
+  synth._osc2.volume_enc = 40;
+  synth._osc2.freq_shift_enc = 24;
 
-void lfo_amp_amp_mod_sustain_callback(RotaryEncoder &encoder) {
-  int state = encoder.get_state();
+  synth._lpf._cutoff_enc = 0;
+  synth._lpf._resonance_enc = 0;
+  synth._master_volume_enc = 40;
 
-  switch (switches[EFFECTS_SEL_SW]._current_state) {
-  case Up: { // LFO AMPLITUDE
+  // Every encoder sets the parameter of its page in the parameter table
+  for (unsigned int i = 0; i < N_ENCODERS; i++) {
+    encoders[i].set_callback(param_encoder_callback);
+  }
 
-    encoder.set_state_clamped(state, 0, 95);
+  // Derive the master and oscillator values from the initial positions. An
+  // oscillator only sounds once selected
+  apply_page(MASTER_PAGE);
+  apply_page(OSC1_PAGE);
+  apply_page(OSC2_PAGE);
+  synth._osc1.enabled = false;
+  synth._osc2.enabled = false;
 
-    float amplitude = LFO_AMPLITUDES[encoder.get_state()];
+  // Define the switches callbacks and call them once
+  switches[OSC_SEL_SW]._callback = oscillator_selection_switch_callback;
+  switches[OSC_SEL_SW].update();
+  switches[EFFECTS_TARGET_SW]._callback = lfo_target_switch_callback;
+  switches[EFFECTS_TARGET_SW].update();
+  switches[EFFECTS_CONF_SW]._callback = effects_configuration_switch_callback;
+  switches[EFFECTS_CONF_SW].update();
+  switches[EFFECTS_SEL_SW]._callback = effects_selection_switch_callback;
+  switches[EFFECTS_SEL_SW].update();
 
-    // Determine which LFO amplitude to modify
-    synth._lfos[synth._lfo_target].set_amplitude(amplitude);
-    printuln("[LFO Amplitude] LFO #%d: %f", synth._lfo_target,
-             synth._lfos[synth._lfo_target]._amplitude);
-    break;
-  }
-  case Down: { // AMPLITUDE MODULATOR SUSTAIN
-    printuln("[AM Sustain] callback not implemented");
-    break;
-  }
-  case Neutral: { // SPECIAL EFFECT 1
-    printuln("[Special Effect] callback not implemented");
-    break;
-  }
-  }
-}
+  oscillator_selection_switch_callback(switches[OSC_SEL_SW]);
+  lfo_target_switch_callback(switches[EFFECTS_TARGET_SW]);
+  effects_configuration_switch_callback(switches[EFFECTS_CONF_SW]);
+  effects_selection_switch_callback(switches[EFFECTS_SEL_SW]);
 
-void amp_mod_release_callback(RotaryEncoder &encoder) {
-  printuln("[AM Release] callback not implemented");
+  printuln("Synthesizer initialization finished!");
 }
 
-int Synthesizer::get_osc_sample(osc_t osc, uint16_t phase) {
-  int sample = 0;
+/// @brief Oscillator sample of a wave known at compile time
+/// Always inlined, so that the kernels stay in the DSP_CODE section
+/// @tparam W the wave
+/// @param osc the oscillator, for the wavetable frame
+/// @param phase the phase
+/// @return the oscillator sample
+template <int W>
+static ALWAYS_INLINE int wave_sample(const osc_t &osc, uint16_t phase) {
+  if constexpr (W == sine) {
+    return ((int)SINE_LUT[phase >> 6]) - 0x8000;
+  } else if constexpr (W == square) {
+    return phase <= 0x8000 ? -0x8000 : 0x8000;
+  } else if constexpr (W == triangle) {
+    return phase <= 0x8000 ? 2 * (phase - 0x4000)   // rising edge of triangle
+                           : -2 * (phase - 0xC000); // falling edge of triangle
+  } else if constexpr (W == sawtooth) {
+    return phase - 0x8000;
+  } else {
+    // Single interpolated read, the morph is done at control rate
+    int index = phase >> 8;
+    int a = osc.wt_frame[index];
+    return a + (((osc.wt_frame[index + 1] - a) * (phase & 0xFF)) >> 8);
+  }
+}
 
+/// @brief Oscillator sample of the oscillator's current wave
+/// Always inlined, it runs for every unison copy of every voice
+/// @param osc the oscillator
+/// @param phase the phase
+/// @return the oscillator sample
+static ALWAYS_INLINE int osc_sample(const osc_t &osc, uint16_t phase) {
   switch (osc.wave) {
   case sine:
-    sample = ((int)SINE_LUT[phase >> 6]) - 0x8000;
-    break;
+    return wave_sample<sine>(osc, phase);
   case square:
-    sample = phase <= 0x8000 ? -0x8000 : 0x8000;
-    break;
+    return wave_sample<square>(osc, phase);
   case triangle:
-    sample = phase <= 0x8000
-                 ? 2 * (phase - 0x4000)   // rising edge of triangle
-                 : -2 * (phase - 0xC000); // falling edge of triangle
-    break;
+    return wave_sample<triangle>(osc, phase);
   case sawtooth:
-    sample = phase - 0x8000;
-    break;
+    return wave_sample<sawtooth>(osc, phase);
+  case wavetable:
+    return wave_sample<wavetable>(osc, phase);
   }
 
-  return sample;
+  return 0;
+}
+
+int Synthesizer::get_osc_sample(const osc_t &osc, uint16_t phase) {
+  return osc_sample(osc, phase);
+}
+
+int Synthesizer::get_unison_sample(Unison &unison, const osc_t &osc) {
+  // Sawtooth copies are mixed fully packed, the other waves per copy
+  if (osc.wave == sawtooth) {
+    return unison.render_saw(_unison);
+  }
+  return unison.render(_unison, [&](uint16_t phase) {
+    return osc_sample(osc, phase);
+  });
 }
 
 float Synthesizer::get_sound_sample(Key &key) {
+  // Phase modulation, oscillator 2 only offsets the phase of oscillator 1
+  // and is not heard. Unison copies have no single phase to modulate
+  if (_fm_index != 0 && _unison.voices == 1 && _osc1.enabled &&
+      _osc2.enabled) {
+    key.increment2 += key.increment_step2;
+    key.phase2 += key.increment2;
+    int modulator = osc_sample(_osc2, key.phase2 >> 16);
+
+    // The offset wraps with the 16-bit phase
+    key.increment1 += key.increment_step1;
+    key.phase1 += key.increment1;
+    uint16_t phase = (key.phase1 >> 16) + ((modulator * _fm_index) >> 8);
+    int sample = osc_sample(_osc1, phase);
+
+    // The modulator's gain keeps ramping, so that leaving FM does not step it
+    key.gain1 += key.gain_step1;
+    key.gain2 += key.gain_step2;
+    return (float)sample * key.gain1;
+  }
+
   // Oscillator 1
   int sample1 = 0;
 
   if (synth._osc1.enabled) {
-    // Obtain sound frequency (including any modulation)
-    float freq = key.get_freq() * synth._osc1.freq_shift;
-    if (synth._lfo_target == OSC1_FREQ) {
-      freq += synth._lfos[OSC1_FREQ].get_sample();
+    if (_unison.voices > 1) {
+      // Phase increments are set at control rate
+      sample1 = get_unison_sample(key.unison1, _osc1);
+    } else {
+      // The phase increment, including modulation, ramps like the gain
+      key.increment1 += key.increment_step1;
+      key.phase1 += key.increment1;
+      sample1 = osc_sample(_osc1, key.phase1 >> 16);
     }
 
-    // Calculate current key phase to select correct oscillator sample value
-    key.phase1 += freq * 0x10000 / SAMPLE_FREQUENCY;
-    sample1 = get_osc_sample(_osc1, key.phase1);
-
-    // Apply desired volume (including any modulation)
-    float vol1 = (float)_osc1.volume / 40000.0;
-    if (synth._lfo_target == OSC1_AMP) {
-      vol1 += synth._lfos[OSC1_AMP].get_sample();
-    }
-    sample1 *= vol1;
+    // Apply the gain (volume, envelope and modulation), ramped across the
+    // control period
+    key.gain1 += key.gain_step1;
+    sample1 *= key.gain1;
   }
 
   // Oscillator 2
   int sample2 = 0;
 
   if (synth._osc2.enabled) {
-    // Obtain sound frequency (including any modulation)
-    float freq = key.get_freq() * synth._osc2.freq_shift;
-    if (synth._lfo_target == OSC2_FREQ) {
-      freq += synth._lfos[OSC2_FREQ].get_sample();
+    if (_unison.voices > 1) {
+      // Phase increments are set at control rate
+      sample2 = get_unison_sample(key.unison2, _osc2);
+    } else {
+      // The phase increment, including modulation, ramps like the gain
+      key.increment2 += key.increment_step2;
+      key.phase2 += key.increment2;
+      sample2 = osc_sample(_osc2, key.phase2 >> 16);
     }
 
-    // Calculate current key phase to select correct oscillator sample value
-    key.phase2 += freq * 0x10000 / SAMPLE_FREQUENCY;
-    sample2 = get_osc_sample(_osc2, key.phase2);
+    // Apply the gain (volume, envelope and modulation), ramped across the
+    // control period
+    key.gain2 += key.gain_step2;
+    sample2 *= key.gain2;
+  }
+
+  return (float)(sample1 + sample2);
+}
+
+void Synthesizer::update_wavetable(osc_t &osc, mod_dest_t dest) {
+  if (osc.wave != wavetable) {
+    return;
+  }
+
+  int position = osc.wt_position + (int)_global_mod[dest];
+
+  int last = (wt_bank._count - 1) * WT_POSITION_PER_FRAME;
+  if (position < 0)
+    position = 0;
+  else if (position > last)
+    position = last;
+
+  // Only re-morph when something changed
+  if (position != osc.wt_rendered || osc.wt_version != wt_bank._version) {
+    wt_bank.morph(osc.wt_frame, position);
+    osc.wt_rendered = position;
+    osc.wt_version = wt_bank._version;
+  }
+}
+
+void Synthesizer::hold(Key &key, uint32_t hold_ms) {
+  key.state = PRESSED;
+  key.hold_until =
+      _clock + (uint32_t)((uint64_t)hold_ms * SAMPLE_FREQUENCY / 1000);
+}
 
-    // Apply desired volume (including any modulation)
-    float vol2 = (float)_osc2.volume / 40000.0;
-    if (synth._lfo_target == OSC2_AMP) {
-      vol2 += synth._lfos[OSC2_AMP].get_sample();
+void Synthesizer::release_expired() {
+  // The notes start between two blocks and last a whole number of blocks,
+  // a per-sample check would release them at the same sample. The wrap of
+  // the clock is handled by the signed difference
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state == PRESSED &&
+        (int32_t)(_clock - keys[j].hold_until) >= 0) {
+      keys[j].state = RELEASED;
     }
-    sample2 *= vol2;
   }
+}
 
-  return (float)(sample1 + sample2);
+void Synthesizer::start_voice(Key &key, uint8_t note) {
+  float increment = NOTE_TABLE.increment[note];
+
+  key.note = note;
+  key.phase1 = 0;
+  key.phase2 = 0;
+  key.gain1 = 0.;
+  key.gain2 = 0.;
+  key.gain_step1 = 0.;
+  key.gain_step2 = 0.;
+  key.increment_step1 = 0;
+  key.increment_step2 = 0;
+  key.envelope.trigger();
+  key.retune = true;
+  _last_voice = &key;
+
+  // Glide from the previous note, if any
+  if (_pitch.glide_rate < 1.f && _pitch.last_increment > 0.f) {
+    key.increment = _pitch.last_increment;
+  } else {
+    key.increment = increment;
+  }
+  _pitch.last_increment = increment;
+}
+
+/// @brief Convert a phase increment to 16.16, below the Nyquist frequency
+static uint32_t clamp_increment(float increment) {
+  return increment < MAX_INCREMENT ? increment : MAX_INCREMENT;
+}
+
+/// @brief Ramp a phase increment towards a target across the control period
+/// @param increment the current increment, set to the target when it jumps
+/// @param step the increment change per sample
+/// @param target the increment at the end of the control period
+/// @param jump whether to take the target at once, for a new note or rate
+/// @param samples number of samples rendered per control period
+static void set_increment(uint32_t &increment, int32_t &step, uint32_t target,
+                          bool jump, int samples) {
+  if (jump) {
+    increment = target;
+    step = 0;
+  } else {
+    // Both are below the Nyquist increment, 2^31, the difference fits
+    step = ((int32_t)target - (int32_t)increment) / samples;
+  }
+}
+
+/// @brief Compute the gain of an oscillator and ramp towards it
+/// @param gain the current gain
+/// @param step the gain change per sample
+/// @param osc the oscillator
+/// @param level the envelope level
+/// @param mod the amplitude modulation
+/// @param samples number of samples rendered per control period
+static void set_gain(float gain, float &step, const osc_t &osc, float level,
+                     float mod, int samples) {
+  float target = (float)osc.volume / 40000.f * level;
+  if (mod > -1.f) {
+    target *= 1.f + mod;
+  } else {
+    target = 0.f;
+  }
+
+  step = (target - gain) / samples;
+}
+
+void Synthesizer::update_modulation() {
+  if (_matrix._dirty) {
+    _matrix.compile(_lfos);
+  }
+
+  // Only the LFOs with an active route run
+  for (int i = 0; i < N_LFOS; i++) {
+    if (_matrix._lfo_mask & (1 << i)) {
+      _lfos[i].tick(CONTROL_PERIOD);
+      _sources[MOD_SRC_LFO + i] = _lfos[i].get_sample();
+    }
+  }
+
+  memset(_mod, 0, sizeof(_mod));
+  _matrix.apply_shared(_sources, _mod);
+}
+
+void Synthesizer::update_voices() {
+  // Without voices, the shared destinations only follow the shared sources
+  memcpy(_global_mod, _mod, sizeof(_global_mod));
+
+  for (int j = 0; j < MAX_KEYS; j++) {
+    Key &key = keys[j];
+    if (key.state == IDLE) {
+      continue;
+    }
+
+    // The gains reached 0 during the previous control period
+    if (key.state == RELEASED && key.envelope._stage == ENV_OFF) {
+      key.state = IDLE;
+      continue;
+    }
+
+    // Per-voice sources, the keyboard has no velocity
+    _sources[MOD_SRC_ENVELOPE] =
+        key.envelope.update(_envelope, key.state == PRESSED);
+    _sources[MOD_SRC_VELOCITY] = 1.;
+    _sources[MOD_SRC_KEY] = (key.note - KEYBOARD_BASE_NOTE) / 24.f;
+
+    float mod[N_MOD_DESTS];
+    memcpy(mod, _mod, sizeof(mod));
+    _matrix.apply_voice(_sources, mod);
+
+    // The filter and wavetables are shared, the newest voice modulates them
+    if (&key == _last_voice) {
+      memcpy(_global_mod, mod, sizeof(_global_mod));
+    }
+
+    // Exponential glide towards the note
+    float target = NOTE_TABLE.increment[key.note];
+    float previous = key.increment;
+    key.increment += (target - key.increment) * _pitch.glide_rate;
+
+    // The increments only follow the note, its glide, the pitch parameters
+    // and the pitch modulation. The oscillators advance once per sample of
+    // the voice core
+    int samples = CONTROL_PERIOD * _oversampling;
+    if (key.retune || (_dirty & DIRTY_PITCH) || key.increment != previous ||
+        mod[MOD_OSC1_FREQ] != key.freq_mod1 ||
+        mod[MOD_OSC2_FREQ] != key.freq_mod2) {
+      // A vibrato or a glide ramps across the control period, a new note or
+      // rate jumps. The unison copies step at control rate from the target
+      bool jump = key.retune || (_dirty & DIRTY_PITCH) || _unison.voices > 1;
+      float increment = key.increment * _pitch.bend_ratio / _oversampling;
+      set_increment(key.increment1, key.increment_step1,
+                    clamp_increment(increment * _osc1.freq_shift *
+                                    exp2f(mod[MOD_OSC1_FREQ] / 12.f)),
+                    jump, samples);
+      set_increment(key.increment2, key.increment_step2,
+                    clamp_increment(increment * _osc2.freq_shift *
+                                    exp2f(mod[MOD_OSC2_FREQ] / 12.f)),
+                    jump, samples);
+      key.freq_mod1 = mod[MOD_OSC1_FREQ];
+      key.freq_mod2 = mod[MOD_OSC2_FREQ];
+      key.retune = false;
+    } else {
+      key.increment_step1 = 0;
+      key.increment_step2 = 0;
+    }
+
+    float level = key.envelope._level;
+    set_gain(key.gain1, key.gain_step1, _osc1, level, mod[MOD_OSC1_AMP],
+             samples);
+    set_gain(key.gain2, key.gain_step2, _osc2, level, mod[MOD_OSC2_AMP],
+             samples);
+  }
+}
+
+void Synthesizer::update_filter() {
+  // The glide of the previous control period is over
+  _lpf.settle();
+
+  if (_lpf._cutoff_enc == 0) {
+    return;
+  }
+
+  // Nothing to do unless a parameter or the modulation changed
+  float cutoff_mod = _global_mod[MOD_LPF_CUTOFF];
+  float resonance_mod = _global_mod[MOD_LPF_RESONANCE];
+  if (!(_dirty & DIRTY_FILTER) && cutoff_mod == _filter_mod[0] &&
+      resonance_mod == _filter_mod[1]) {
+    return;
+  }
+  _filter_mod[0] = cutoff_mod;
+  _filter_mod[1] = resonance_mod;
+
+  float cutoff =
+      CUTOFF_FREQUENCIES_96[_lpf._cutoff_enc] * exp2f(cutoff_mod);
+  if (cutoff > MAX_CUTOFF_RATIO * SAMPLE_FREQUENCY) {
+    cutoff = MAX_CUTOFF_RATIO * SAMPLE_FREQUENCY;
+  }
+
+  float resonance =
+      BUTTERWORTH_Q * exp2f((float)_lpf._resonance_enc /
+                                RESONANCE_ENC_PER_OCTAVE +
+                            resonance_mod);
+  if (resonance > MAX_RESONANCE) {
+    resonance = MAX_RESONANCE;
+  }
+
+  // The coefficients are only recomputed when something changed. They glide
+  // to a new modulation across the control period, and take a new parameter
+  // at once, the filter may have been bypassed until then
+  if (_dirty & DIRTY_FILTER) {
+    _lpf.set_parameters(cutoff, resonance);
+  } else if (cutoff / _lpf.get_sampling_freq() != _lpf._cutoff_freq ||
+             resonance != _lpf._resonance) {
+    _lpf.glide(cutoff, resonance, CONTROL_PERIOD * _oversampling);
+  }
+}
+
+void Synthesizer::update_unison() {
+  if (_unison.voices <= 1) {
+    return;
+  }
+
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state == IDLE) {
+      continue;
+    }
+
+    keys[j].unison1.set_increment(keys[j].increment1, _unison);
+    keys[j].unison2.set_increment(keys[j].increment2, _unison);
+  }
 }
 
-void Synthesizer::makesynth(uint8_t *block) {
-  for (int i = 0; i < BLOCK_SIZE; i += 2) {
-    float sample = 0;
+void Synthesizer::update_fm() {
+  // One-pole, a quarter of the way every control period (about 6 ms)
+  int32_t diff = _fm.index - _fm_index;
+  if (diff > -4 && diff < 4) {
+    _fm_index = _fm.index;
+  } else {
+    _fm_index += diff / 4;
+  }
+}
+
+void Synthesizer::control_tick() {
+  update_modulation();
+  update_voices();
+  update_filter();
+  update_wavetable(_osc1, MOD_OSC1_WAVE);
+  update_wavetable(_osc2, MOD_OSC2_WAVE);
+  update_unison();
+  update_fm();
+
+  // The derived values are up to date
+  _dirty = 0;
+}
+
+void Synthesizer::set_oversampling(uint8_t factor) {
+  if (factor == _oversampling) {
+    return;
+  }
+
+  // The increments and gain ramps follow at the next control tick
+  _oversampling = factor;
+  _lpf.set_sampling_freq(SAMPLE_FREQUENCY * factor);
+  _decimator.reset();
+  _dirty |= DIRTY_FILTER | DIRTY_PITCH;
+}
 
-    // get the synthesized sound for every pressed key
-    for (int j = 0; j < MAX_KEYS; j++) {
-      if (keys[j].state == PRESSED &&
-          !sys_timepoint_expired(keys[j].hold_time)) {
-        sample += get_sound_sample(keys[j]);
-      } else if (keys[j].state == PRESSED &&
-                 sys_timepoint_expired(keys[j].hold_time)) {
-        keys[j].state = IDLE;
+float Synthesizer::mix_voices() {
+  float sample = 0;
+
+  // get the synthesized sound for every sounding key, released keys sound
+  // until the end of their envelope
+  for (int j = 0; j < MAX_KEYS; j++) {
+    if (keys[j].state != IDLE) {
+      sample += get_sound_sample(keys[j]);
+    }
+  }
+
+  // Apply LPF
+  if (_lpf._cutoff_enc > 0) {
+    sample = _lpf.filter(sample);
+  }
+
+  return sample;
+}
+
+DSP_CODE void Synthesizer::render_generic(float *out, int n) {
+  for (int s = 0; s < n; s++) {
+    out[s] = mix_voices();
+  }
+}
+
+template <int W1, int W2, bool FILTER>
+DSP_CODE void Synthesizer::render_kernel(float *out, int n) {
+  for (int s = 0; s < n; s++) {
+    out[s] = 0.;
+  }
+
+  // One key at a time, its phases and gains stay in registers. The keys are
+  // added in the same order as mix_voices(), the sums are the same
+  for (int j = 0; j < MAX_KEYS; j++) {
+    Key &key = keys[j];
+    if (key.state == IDLE) {
+      continue;
+    }
+
+    for (int s = 0; s < n; s++) {
+      int sample1 = 0;
+      if constexpr (W1 != KERNEL_WAVE_OFF) {
+        key.increment1 += key.increment_step1;
+        key.phase1 += key.increment1;
+        sample1 = wave_sample<W1>(_osc1, key.phase1 >> 16);
+        key.gain1 += key.gain_step1;
+        sample1 *= key.gain1;
+      }
+
+      int sample2 = 0;
+      if constexpr (W2 != KERNEL_WAVE_OFF) {
+        key.increment2 += key.increment_step2;
+        key.phase2 += key.increment2;
+        sample2 = wave_sample<W2>(_osc2, key.phase2 >> 16);
+        key.gain2 += key.gain_step2;
+        sample2 *= key.gain2;
       }
+
+      out[s] += (float)(sample1 + sample2);
     }
+  }
 
-    // Apply LPF
-    if (synth._lpf._cutoff_freq > 0.) {
-      sample = synth._lpf.filter(sample);
+  if constexpr (FILTER) {
+    for (int s = 0; s < n; s++) {
+      out[s] = _lpf.filter(out[s]);
     }
+  }
+}
 
-    // clamp the value
-    if (sample > 0x7fff)
-      sample = 0x7fff;
-    else if (sample < -0x7fff)
-      sample = -0x7fff;
+/// @brief Whether a combination has its own kernel, see RENDER_KERNELS
+static constexpr bool kernel_specialized(int w1, int w2) {
+  return RENDER_KERNELS == 2 ||
+         (RENDER_KERNELS == 1 &&
+          (w1 == w2 || w1 == KERNEL_WAVE_OFF || w2 == KERNEL_WAVE_OFF));
+}
+
+/// @brief Kernel table size, indexed by (W1 * N_KERNEL_WAVES + W2) * 2 +
+/// FILTER
+static const size_t N_KERNELS = N_KERNEL_WAVES * N_KERNEL_WAVES * 2;
+
+template <size_t I> static constexpr render_kernel_t kernel_entry() {
+  constexpr int w1 = I / (2 * N_KERNEL_WAVES);
+  constexpr int w2 = I / 2 % N_KERNEL_WAVES;
+  if constexpr (kernel_specialized(w1, w2)) {
+    return &Synthesizer::render_kernel<w1, w2, I % 2 == 1>;
+  } else {
+    return &Synthesizer::render_generic;
+  }
+}
+
+template <size_t... I>
+static constexpr std::array<render_kernel_t, sizeof...(I)>
+make_kernel_table(std::index_sequence<I...>) {
+  return {{kernel_entry<I>()...}};
+}
+
+static constexpr std::array<render_kernel_t, N_KERNELS> KERNELS =
+    make_kernel_table(std::make_index_sequence<N_KERNELS>());
 
-    block[i] = (int16_t)sample & 0xFF;
-    block[i + 1] = (int16_t)sample >> 8;
+render_kernel_t Synthesizer::select_kernel() {
+  // FM can start or stop within a block as its index is smoothed
+  if (_unison.voices > 1 || _fm.index != 0 || _fm_index != 0) {
+    return &Synthesizer::render_generic;
   }
+
+  int w1 = _osc1.enabled ? _osc1.wave : KERNEL_WAVE_OFF;
+  int w2 = _osc2.enabled ? _osc2.wave : KERNEL_WAVE_OFF;
+  return KERNELS[(w1 * N_KERNEL_WAVES + w2) * 2 + (_lpf._cutoff_enc > 0)];
+}
+
+DSP_CODE void Synthesizer::makesynth(uint8_t *block) {
+  // The voices rendered below are settled for the whole block
+  release_expired();
+  render_kernel_t kernel = select_kernel();
+
+  int16_t *samples = (int16_t *)block;
+  float voices[CONTROL_PERIOD * QUALITY_OVERSAMPLING];
+
+  // The master gain ramps from _output_gain across the block. It scales the
+  // echoes and the reverb tail with the dry signal and not the distortion
+  // drive, so the last active stage applies it in its final write, or the
+  // conversion below when no effect is on
+  float target = _muted ? 0.f : _master_gain;
+  gain_ramp_t ramp = gain_ramp(_output_gain, target, SAMPLES_PER_BLOCK);
+  gain_ramp_t *last = &ramp;
+  gain_ramp_t *room = nullptr;
+  gain_ramp_t *echo = nullptr;
+  gain_ramp_t *ensemble = nullptr;
+  gain_ramp_t *distortion = nullptr;
+#if REVERB_ENABLED
+  if (_reverb.wet != 0) {
+    room = last;
+    last = nullptr;
+  }
+#endif
+  if (_delay.length != 0) {
+    echo = last;
+    last = nullptr;
+  }
+  if (_chorus.mix != 0) {
+    ensemble = last;
+    last = nullptr;
+  }
+  if (_shaper.drive != 0) {
+    distortion = last;
+    last = nullptr;
+  }
+  float gain = last != nullptr ? _output_gain : 1.f;
+  float gain_step = last != nullptr ? (target - gain) / SAMPLES_PER_BLOCK : 0.f;
+  _output_gain = target;
+
+  for (int i = 0; i < SAMPLES_PER_BLOCK; i += CONTROL_PERIOD) {
+    // Control-rate updates at the start of every control period
+    control_tick();
+
+    int n = SAMPLES_PER_BLOCK - i < CONTROL_PERIOD ? SAMPLES_PER_BLOCK - i
+                                                   : CONTROL_PERIOD;
+    (this->*kernel)(voices, n * _oversampling);
+
+    for (int s = 0; s < n; s++) {
+      // At 2x, the voices and the filter run at twice the rate
+      // and the halfband filter removes what would fold back below 22 kHz
+      float sample;
+      if (_oversampling > 1) {
+        sample = _decimator.decimate(voices[2 * s], voices[2 * s + 1]);
+      } else {
+        sample = voices[s];
+      }
+      // clamp the value
+      if (sample > 0x7fff)
+        sample = 0x7fff;
+      else if (sample < -0x7fff)
+        sample = -0x7fff;
+
+      samples[i + s] = (int16_t)(sample * gain);
+      gain += gain_step;
+    }
+  }
+
+  // The effects run on the whole block: the distortion first, then the chorus
+  // so that the echoes and the reverb tail are not modulated
+  _distortion.process(samples, SAMPLES_PER_BLOCK, _shaper, distortion);
+  _ensemble.process(samples, SAMPLES_PER_BLOCK, _chorus, ensemble);
+  _echo.process(samples, SAMPLES_PER_BLOCK, _delay, echo);
+#if REVERB_ENABLED
+  _room.process(samples, SAMPLES_PER_BLOCK, _reverb, room);
+#endif
+
+  _clock += SAMPLES_PER_BLOCK;
 }
\ No newline at end of file
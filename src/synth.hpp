@@ -3,30 +3,71 @@
 
 #include "Switch.hpp"
 #include "audio.h"
+#include "chorus.hpp"
+#include "delay.hpp"
+#include "envelope.hpp"
 #include "filter.hpp"
+#include "halfband.hpp"
 #include "key.hpp"
 #include "lfo.hpp"
+#include "modmatrix.hpp"
+#include "notes.hpp"
 #include "peripherals.h"
+#include "reverb.hpp"
 #include "sine.hpp"
+#include "unison.hpp"
+#include "waveshaper.hpp"
+#include "wavetable.hpp"
 #include <stdint.h>
 
-const float SHIFT_FREQUENCIES[] = {
-    0.250, 0.265, 0.281, 0.297, 0.315, 0.334, 0.354, 0.375, 0.397, 0.420,
-    0.445, 0.472, 0.500, 0.530, 0.561, 0.595, 0.630, 0.667, 0.707, 0.749,
-    0.794, 0.841, 0.891, 0.944, 1.000, 1.059, 1.122, 1.189, 1.260, 1.335,
-    1.414, 1.498, 1.587, 1.682, 1.782, 1.888, 2.000, 2.119, 2.245, 2.378,
-    2.520, 2.670, 2.828, 2.997, 3.175, 3.364, 3.564, 3.775, 4.000};
+/// @brief Oscillator frequency multipliers, one semitone per encoder step
+extern const float SHIFT_FREQUENCIES[49];
 
 const uint16_t DEFAULT_MASTER_VALUE = 25600;
 
+/// @brief Number of samples between two control-rate updates
+const int CONTROL_PERIOD = 64;
+
+/**
+ * Derived values whose parameters changed, see Synthesizer::_dirty. They are
+ * recomputed at the next control tick
+ */
+const uint8_t DIRTY_FILTER = 1 << 0; // filter coefficients
+const uint8_t DIRTY_PITCH = 1 << 1;  // phase increments of the voices
+const uint8_t DIRTY_ALL = DIRTY_FILTER | DIRTY_PITCH;
+
+/// @brief Oversampling factor of the voice core at its higher rate
+const uint8_t QUALITY_OVERSAMPLING = 2;
+
+/// @brief First wave encoder position that selects the wavetable, the fixed
+/// waves use 8 positions each below it
+const int WAVETABLE_ENC_START = 32;
+/// @brief Wave encoder positions per wavetable frame
+const int WAVETABLE_ENC_PER_FRAME = 8;
+
 /// @brief Basic oscillator waves
 typedef enum wavetype {
   sine = 0,
   triangle = 1,
   square = 2,
-  sawtooth = 3
+  sawtooth = 3,
+  wavetable = 4
 } wavetype_t;
 
+/// @brief Render kernel wave of a disabled oscillator, after the waves
+const int KERNEL_WAVE_OFF = 5;
+/// @brief Render kernel waves per oscillator, the waves and off
+const int N_KERNEL_WAVES = 6;
+
+// Render kernels specialized on the oscillator waves and the filter, the
+// other combinations use the generic kernel:
+//   0: none, every block takes the generic kernel
+//   1: a single oscillator, or both on the same wave (30 kernels)
+//   2: every combination (72 kernels)
+// Every kernel is DSP_CODE, see the [Bench] kernel lines and
+// tools/kernel_sizes.sh to weigh the cycles against the RAM
+#define RENDER_KERNELS (1)
+
 /// @brief Oscillator data structure
 typedef struct osc {
   uint16_t volume;
@@ -36,28 +77,91 @@ typedef struct osc {
   float freq_shift;
   int freq_shift_enc;
   bool enabled;
+  uint16_t wt_position;                // wavetable morph position
+  uint16_t wt_rendered;                // morph position of wt_frame
+  uint32_t wt_version;                 // bank version of wt_frame
+  int16_t wt_frame[WT_FRAME_SIZE + 1]; // morphed frame read by the renderer
 } osc_t;
 
+/// @brief Resonance encoder steps per doubling of the filter's Q
+const int RESONANCE_ENC_PER_OCTAVE = 12;
+/// @brief Largest filter Q, including modulation
+const float MAX_RESONANCE = 20.;
+/// @brief Largest filter cut-off frequency, including modulation, relative to
+/// the sampling frequency
+const float MAX_CUTOFF_RATIO = 0.45;
+
+/// @brief Pitch bend range, in semitones
+const int PITCH_BEND_RANGE = 2;
+
+/// @brief Pitch parameters shared by all voices
+typedef struct pitch {
+  float bend;           // pitch bend, in semitones
+  float bend_ratio;     // frequency ratio of the pitch bend
+  float glide_time;     // portamento time constant, in seconds
+  float glide_rate;     // glide step per control period, 1 = no glide
+  float last_increment; // increment of the last note played, glides start here
+  int bend_enc;
+  int glide_enc;
+} pitch_t;
+
+/// @brief Largest FM index encoder position
+const int FM_INDEX_ENC_MAX = 32;
+/// @brief FM index per encoder step, Q8
+const int FM_INDEX_PER_STEP = 32;
+
+/// @brief Phase modulation of oscillator 1 by oscillator 2
+/// The index is the peak phase offset of the carrier, Q8: 256 is half a
+/// cycle (pi radians) for a full scale modulator
+typedef struct fm {
+  int32_t index; // target index, 0 = plain mixing of the two oscillators
+  int index_enc;
+} fm_t;
+
+/// @brief Special effects pages, selected by the effects configuration and
+/// target switches while the effects selection switch is neutral
+typedef enum effect_page {
+  NO_PAGE = -1,
+  UNISON_PAGE,
+  PITCH_PAGE,
+  DELAY_PAGE,
+  DELAY_SYNC_PAGE,
+  REVERB_PAGE,
+  CHORUS_PAGE,
+  CHORUS_SHAPE_PAGE,
+  SHAPER_PAGE,
+  VOICE_PAGE
+} effect_page_t;
+
 /// @brief Oscillators switch callback
 void oscillator_selection_switch_callback(ThreePosSwitch &sw);
-/// @brief Encoder 0 callback
-void lpf_res_osc_freq_encoder_callback(RotaryEncoder &encoder);
-/// @brief Encoder 1 callback
-void lpf_cutoff_wavetype_encoder_callback(RotaryEncoder &encoder);
-/// @brief Encoder 2 callback
-void volume_encoder_callback(RotaryEncoder &encoder);
-
 /// @brief LFO target selector switch callback
 void lfo_target_switch_callback(ThreePosSwitch &sw);
 void effects_configuration_switch_callback(ThreePosSwitch &sw);
 void effects_selection_switch_callback(ThreePosSwitch &sw);
 
-/// @brief Encoder 3 callback
-void lfo_freq_amp_mod_attack_callback(RotaryEncoder &encoder);
-/// @brief Encoder 4 callback
-void lfo_amp_amp_mod_sustain_callback(RotaryEncoder &encoder);
-/// @brief Encoder 5 callback
-void amp_mod_release_callback(RotaryEncoder &encoder);
+/// @brief Callback of every encoder
+/// Looks the parameter of the encoder's page up in the parameter table,
+/// clamps the encoder to its range, stores the position and updates the
+/// values derived from it
+void param_encoder_callback(RotaryEncoder &encoder);
+
+/// @brief Codec volume, a fixed range the digital master gain works in
+const uint8_t MASTER_CODEC_VOLUME = 100;
+/// @brief Last master volume encoder position, 0 dB
+const int MASTER_VOLUME_ENC_MAX = 50;
+/// @brief Master gain change per master volume encoder step, in dB
+const float MASTER_DB_PER_STEP = 0.75;
+
+/// @brief Digital master gain of a master volume encoder position
+/// The first position mutes
+/// @param volume_enc the master volume encoder position
+/// @return the linear gain
+float get_master_gain(int volume_enc);
+
+/// @brief Point the encoders at the parameters selected by the switches,
+/// without calling their callbacks
+void load_encoders();
 
 /// @brief LUT that outputs the LFO's target based on switch positions
 /// @param osc_sw switch 0 state
@@ -67,14 +171,55 @@ void amp_mod_release_callback(RotaryEncoder &encoder);
 lfo_target_t get_lfo_target(ThreeWaySwitchState osc_sw,
                             ThreeWaySwitchState lfo_target_sw);
 
+/// @brief LUT that outputs the special effects page based on switch positions
+/// @param conf_sw effects configuration switch state
+/// @param target_sw effects target switch state
+/// @return the special effects page
+effect_page_t get_effect_page(ThreeWaySwitchState conf_sw,
+                              ThreeWaySwitchState target_sw);
+
+class Synthesizer;
+
+/// @brief Renders a run of samples within a control period, see
+/// Synthesizer::select_kernel()
+typedef void (Synthesizer::*render_kernel_t)(float *out, int n);
+
 class Synthesizer {
 public:
   int _master_volume_enc;
+  float _master_gain; // digital master gain, from the master volume encoder
+  float _output_gain; // gain of the final output, ramps to _master_gain
+  bool _muted;        // output ramped to silence, e.g. around a flash write
   osc_t _osc1;
   osc_t _osc2;
   Filter _lpf;
-  LFO _lfos[5];
-  lfo_target_t _lfo_target;
+  LFO _lfos[N_LFOS];
+  lfo_target_t _lfo_target; // LFO edited by the LFO encoders
+  ModMatrix _matrix;
+  float _sources[N_MOD_SOURCES];  // modulation source values
+  float _mod[N_MOD_DESTS];        // modulation from the shared sources
+  float _global_mod[N_MOD_DESTS]; // modulation of the shared destinations
+  Key *_last_voice;               // newest voice, modulates the shared ones
+  uint8_t _oversampling;          // voice core rate, 1x or 2x
+  uint32_t _clock;                // samples rendered, the note-off deadlines
+  uint8_t _dirty;                 // DIRTY_* values to recompute
+  float _filter_mod[2]; // cut-off and resonance modulation of the filter
+  HalfbandDecimator _decimator;   // oversampled mix back to 1x
+  envelope_t _envelope;
+  unison_t _unison;
+  pitch_t _pitch;
+  fm_t _fm;
+  int32_t _fm_index; // FM index smoothed at control rate, Q8
+  shaper_t _shaper;
+  Waveshaper _distortion; // resampling filters
+  chorus_t _chorus;
+  Chorus _ensemble; // modulated line position and LFO
+  delay_t _delay;
+  Delay _echo; // delay line position and feedback state
+#if REVERB_ENABLED
+  reverb_t _reverb;
+  Reverb _room; // reverb line positions and filter states
+#endif
 
   /// @brief Synthesizer default constructor
   Synthesizer()
@@ -83,10 +228,89 @@ public:
         _osc2{DEFAULT_MASTER_VALUE, 0, square, 0, 1., 0, false},
         _lpf{SAMPLE_FREQUENCY, 0.} {
     // Initialize all LFOs
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < N_LFOS; i++) {
       _lfos[i] = LFO(0., SAMPLE_FREQUENCY, 0., 0);
     }
     _lfo_target = NONE;
+    _master_gain = 1.;
+    _output_gain = 1.;
+    _muted = false;
+    for (int i = 0; i < N_MOD_SOURCES; i++) {
+      _sources[i] = 0.;
+    }
+    for (int i = 0; i < N_MOD_DESTS; i++) {
+      _mod[i] = 0.;
+      _global_mod[i] = 0.;
+    }
+    _last_voice = nullptr;
+    _oversampling = 1;
+    _clock = 0;
+    _dirty = DIRTY_ALL;
+    _filter_mod[0] = 0.;
+    _filter_mod[1] = 0.;
+
+    // Instant attack and release, full sustain
+    _envelope.attack_step = 1.;
+    _envelope.sustain = 1.;
+    _envelope.release_step = 1.;
+    _envelope.attack_enc = 0;
+    _envelope.sustain_enc = 32;
+    _envelope.release_enc = 0;
+
+    // Unison off
+    _unison.voices = 1;
+    _unison.detune = 0.;
+    _unison.mix = 1.;
+    _unison.voices_enc = 0;
+    _unison.detune_enc = 0;
+    _unison.mix_enc = 32;
+    unison_update(_unison);
+
+    // No pitch bend, no glide
+    _pitch.bend = 0.;
+    _pitch.bend_ratio = 1.;
+    _pitch.glide_time = 0.;
+    _pitch.glide_rate = 1.;
+    _pitch.last_increment = 0.;
+    _pitch.bend_enc = 0;
+    _pitch.glide_enc = 0;
+
+    // Plain mixing
+    _fm.index = 0;
+    _fm.index_enc = 0;
+    _fm_index = 0;
+
+    // Distortion off, 2x oversampling
+    _shaper.drive_enc = 0;
+    _shaper.level_enc = 24;
+    _shaper.factor_enc = 1;
+    shaper_update(_shaper);
+
+    // Chorus off, 15.5 ms center delay swept at 0.5 Hz
+    _chorus.rate_enc = 20;
+    _chorus.depth_enc = 8;
+    _chorus.mix_enc = 0;
+    _chorus.delay_enc = 30;
+    _chorus.feedback_enc = 0;
+    _chorus.shape = LFO_SINE;
+    chorus_update(_chorus);
+
+    // Delay off, 120 BPM
+    _delay.bpm = 120;
+    _delay.sync = false;
+    _delay.time_enc = 0;
+    _delay.feedback_enc = 12;
+    _delay.mix_enc = 12;
+    _delay.damping_enc = 8;
+    delay_update(_delay);
+
+#if REVERB_ENABLED
+    // Reverb off, medium room
+    _reverb.room_enc = 16;
+    _reverb.damping_enc = 16;
+    _reverb.mix_enc = 0;
+    reverb_update(_reverb);
+#endif
   }
 
   /// @brief Synthesizer initialization function
@@ -94,16 +318,106 @@ public:
   /// fuctions
   void initialize();
 
+  /// @brief Start playing a note on a key
+  /// The glide starts from the previous note played
+  /// @param key the key
+  /// @param note the MIDI note number
+  void start_voice(Key &key, uint8_t note);
+
+  /// @brief Press a key for a while
+  /// The key is released at the first block that starts after the hold time,
+  /// its envelope then enters the release stage
+  /// @param key the key
+  /// @param hold_ms the hold time in milliseconds
+  void hold(Key &key, uint32_t hold_ms);
+
+  /// @brief Release the pressed keys whose hold time is over
+  /// Called once per block, before rendering
+  void release_expired();
+
+  /// @brief Select the rate of the voice core
+  /// Above 1x, the voices and the filter run at the higher rate and the mix
+  /// is decimated back by a halfband filter shared by all voices
+  /// @param factor 1 or QUALITY_OVERSAMPLING
+  void set_oversampling(uint8_t factor);
+
   /// @brief Compute the next oscillator output sample
+  /// Not on the render path, which inlines the wave lookup
   /// @param osc the oscillator you want to generate sample for
   /// @param phase the current phase to generate sample with
   /// @return the next oscillator sample
-  int get_osc_sample(osc_t osc, uint16_t phase);
+  int get_osc_sample(const osc_t &osc, uint16_t phase);
+
+  // The per-sample helpers below are inlined into the render kernels, which
+  // are DSP_CODE: DSP_CODE implies noinline and a long call, see memmap.h
+
+  /// @brief Compute the next sample of all unison copies of an oscillator
+  /// @param unison the key's unison state for this oscillator
+  /// @param osc the oscillator
+  /// @return the next oscillator sample
+  ALWAYS_INLINE int get_unison_sample(Unison &unison, const osc_t &osc);
 
   /// @brief Compute next sound value for a specific key
   /// @param key the key you want to generate sound with
   /// @return the next sound value
-  float get_sound_sample(Key &key);
+  ALWAYS_INLINE float get_sound_sample(Key &key);
+
+  /// @brief Mix the next sample of all sounding keys and filter it, at the
+  /// rate of the voice core
+  /// @return the filtered mix
+  ALWAYS_INLINE float mix_voices();
+
+  /// @brief Generic render kernel, every wave, unison and FM
+  /// @param out the filtered mix, at the rate of the voice core
+  /// @param n number of samples, within a control period
+  void render_generic(float *out, int n);
+
+  /// @brief Render kernel specialized on the oscillator waves and the
+  /// filter, without unison nor FM
+  /// @tparam W1 oscillator 1 wave, KERNEL_WAVE_OFF when disabled
+  /// @tparam W2 oscillator 2 wave, KERNEL_WAVE_OFF when disabled
+  /// @tparam FILTER whether the low-pass filter is on
+  /// @param out the filtered mix, at the rate of the voice core
+  /// @param n number of samples, within a control period
+  template <int W1, int W2, bool FILTER> void render_kernel(float *out, int n);
+
+  /// @brief Pick the render kernel of the current parameters
+  /// The parameters that select it only change between two blocks
+  /// @return the kernel rendering the next block
+  render_kernel_t select_kernel();
+
+  /// @brief Update the parameters that change at control rate
+  /// Called every CONTROL_PERIOD samples by makesynth
+  void control_tick();
+
+  /// @brief Advance the routed LFOs by a control period and walk the shared
+  /// modulation routes. Recompiles the routes if they changed
+  void update_modulation();
+
+  /// @brief Advance the envelopes, walk the per-voice modulation routes and
+  /// set the phase increments and gains of all sounding keys
+  /// Glide and pitch bend are applied here. The increments of a key are only
+  /// recomputed when DIRTY_PITCH is set, or its note, glide or pitch
+  /// modulation changed
+  void update_voices();
+
+  /// @brief Update the filter coefficients from the encoders and modulation
+  /// Only when DIRTY_FILTER is set or the modulation changed
+  void update_filter();
+
+  /// @brief Update the unison phase increments of all pressed keys
+  void update_unison();
+
+  /// @brief Move the FM index a step towards its target
+  /// The index is only read at control rate, so that an encoder turn does
+  /// not step the carrier's phase offset
+  void update_fm();
+
+  /// @brief Re-morph an oscillator's wavetable frame if its position or the
+  /// bank changed
+  /// @param osc the oscillator
+  /// @param dest the modulation destination of this oscillator's wavetable
+  void update_wavetable(osc_t &osc, mod_dest_t dest);
 
   /// @brief Populate the audio buffer with sound
   /// @param block the audio buffer
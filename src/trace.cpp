@@ -0,0 +1,153 @@
+#include "trace.h"
+
+#include <zephyr/kernel.h>
+
+#include "usb.h"
+
+#ifdef CONFIG_TRACING_USER
+#include <cmsis_core.h>
+
+/// @brief One trace record, laid out as a CTF event of tools/ctf/metadata
+typedef struct __packed trace_record {
+  uint8_t id;
+  uint32_t timestamp; // cycle counter
+  uint8_t a;
+  uint16_t b;
+  uint32_t c;
+} trace_record_t;
+
+static trace_record_t trace_ring[TRACE_RING_RECORDS];
+static uint32_t trace_head = 0;  // next record written
+static uint32_t trace_count = 0; // records in the ring
+static bool trace_frozen = false;
+// Dump in progress, records left to write and index of the next one
+static uint32_t dump_left = 0;
+static uint32_t dump_next = 0;
+
+void trace_event(trace_id_t id, uint8_t a, uint16_t b, uint32_t c) {
+  unsigned int key = irq_lock();
+
+  if (!trace_frozen) {
+    trace_record_t &record = trace_ring[trace_head];
+    record.id = id;
+    record.timestamp = k_cycle_get_32();
+    record.a = a;
+    record.b = b;
+    record.c = c;
+
+    // The oldest record is overwritten once the ring is full
+    trace_head = (trace_head + 1) % TRACE_RING_RECORDS;
+    if (trace_count < TRACE_RING_RECORDS) {
+      trace_count++;
+    }
+  }
+
+  irq_unlock(key);
+}
+
+/// @brief Current IRQ number, negative (as int8) for the system exceptions
+static uint8_t current_irq() { return (uint8_t)(__get_IPSR() - 16); }
+
+extern "C" {
+
+void sys_trace_thread_switched_in_user(void) {
+  k_tid_t thread = k_current_get();
+  trace_event(TRACE_THREAD_IN, (uint8_t)k_thread_priority_get(thread), 0,
+              (uint32_t)(uintptr_t)thread);
+}
+
+void sys_trace_thread_switched_out_user(void) {
+  k_tid_t thread = k_current_get();
+  trace_event(TRACE_THREAD_OUT, (uint8_t)k_thread_priority_get(thread), 0,
+              (uint32_t)(uintptr_t)thread);
+}
+
+void sys_trace_isr_enter_user(int nested_interrupts) {
+  trace_event(TRACE_ISR_ENTER, current_irq(), nested_interrupts, 0);
+}
+
+void sys_trace_isr_exit_user(int nested_interrupts) {
+  trace_event(TRACE_ISR_EXIT, current_irq(), nested_interrupts, 0);
+}
+
+void sys_trace_idle_user(void) { trace_event(TRACE_IDLE, 0, 0, 0); }
+}
+
+/// @brief Print the address and name of a thread, to name the thread events
+static void print_thread(const struct k_thread *thread, void *user_data) {
+  ARG_UNUSED(user_data);
+
+  const char *name = k_thread_name_get((k_tid_t)thread);
+  printuln("[Trace] thread %p %s", thread, name != nullptr ? name : "?");
+}
+
+/// @brief Empty the ring and give the port back once the dump is over
+static void trace_dump_end() {
+  dump_left = 0;
+  trace_head = 0;
+  trace_count = 0;
+  trace_frozen = false;
+  usbReserve(0);
+}
+
+/// @brief Start writing the ring, oldest record first
+static void trace_dump() {
+  // A second command during a dump is ignored
+  if (trace_frozen) {
+    return;
+  }
+  trace_frozen = true;
+
+  k_thread_foreach(print_thread, nullptr);
+  printuln("[Trace] %u bytes", trace_count * sizeof(trace_record_t));
+
+  // The TX buffer is much smaller than the ring, the records are written by
+  // trace_poll() as it drains
+  dump_next = (trace_head + TRACE_RING_RECORDS - trace_count) %
+              TRACE_RING_RECORDS;
+  dump_left = trace_count;
+  usbReserve(1);
+  if (dump_left == 0) {
+    trace_dump_end();
+  }
+}
+#endif
+
+void trace_poll() {
+#ifdef CONFIG_TRACING_USER
+  if (dump_left == 0) {
+    return;
+  }
+
+  // The host closed the port, the rest of the stream is useless
+  if (!usbConnected()) {
+    trace_dump_end();
+    return;
+  }
+
+  uint32_t records = usbTxSpace() / sizeof(trace_record_t);
+  records = MIN(records, MIN(dump_left, TRACE_DUMP_RECORDS_PER_BLOCK));
+  for (uint32_t i = 0; i < records; i++) {
+    usbWrite((const uint8_t *)&trace_ring[dump_next], sizeof(trace_record_t));
+    dump_next = (dump_next + 1) % TRACE_RING_RECORDS;
+  }
+
+  dump_left -= records;
+  if (dump_left == 0) {
+    trace_dump_end();
+  }
+#endif
+}
+
+bool trace_feed(uint8_t byte) {
+  if (byte != TRACE_DUMP_START) {
+    return false;
+  }
+
+#ifdef CONFIG_TRACING_USER
+  trace_dump();
+#else
+  printuln("[Trace] Not built in, build with overlay-tracing.conf");
+#endif
+  return true;
+}
@@ -0,0 +1,78 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/**
+ * Event trace in a RAM ring, dumped over the CDC port as a CTF stream
+ *
+ * Build with overlay-tracing.conf to enable it: the kernel then reports the
+ * thread switches, ISRs and idle entries through the user tracing hooks, and
+ * the TRACE() points of the application are recorded next to them. Without
+ * it, TRACE() compiles to nothing.
+ *
+ * Dump protocol, over the CDC port:
+ *   0x05 (ENQ)
+ * answered by one "[Trace] thread <address> <name>" line per thread, a
+ * "[Trace] <n> bytes" line and the n bytes of the stream, oldest record
+ * first. Saved as channel0_0 next to tools/ctf/metadata, the stream opens in
+ * Trace Compass or babeltrace. The ring restarts empty after a dump.
+ *
+ * The stream is written a few records per block, so that audio keeps running
+ * during the dump. Meanwhile the port is reserved to it: the lines printed by
+ * the rest of the firmware are dropped and counted, see usbReserve().
+ */
+const uint8_t TRACE_DUMP_START = 0x05;
+
+/// @brief Records kept in the ring, 12 bytes each. About half a second of
+/// activity, the USB interrupt alone fires every millisecond
+#define TRACE_RING_RECORDS (1024)
+
+/// @brief Records written per block during a dump, at most what the TX buffer
+/// holds. 64 records per 50 ms block send the full ring in under a second
+#define TRACE_DUMP_RECORDS_PER_BLOCK (64)
+
+/// @brief Trace event identifiers, the event ids of tools/ctf/metadata
+typedef enum trace_id {
+  TRACE_THREAD_IN,    // c: thread address, a: priority
+  TRACE_THREAD_OUT,   // c: thread address, a: priority
+  TRACE_ISR_ENTER,    // a: IRQ number, b: nesting level
+  TRACE_ISR_EXIT,     // a: IRQ number, b: nesting level
+  TRACE_IDLE,         // the CPU goes idle
+  TRACE_RENDER_START, // c: block number, a: sounding voices
+  TRACE_RENDER_END,   // c: block number
+  TRACE_VOICE,        // a: note, b: key index
+  TRACE_PARAM,        // a: encoder, c: encoder state
+  TRACE_PRESET,       // a preset was applied
+  TRACE_I2S_START,    // the block is handed to the I2S driver
+  TRACE_I2S_END,      // c: driver return value
+  TRACE_I2C_START,    // a: device address, b: register address, c: writes
+  TRACE_I2C_END       // a: device address, c: driver return value
+} trace_id_t;
+
+#ifdef CONFIG_TRACING_USER
+/// @brief Record an event in the ring
+/// Safe from threads and interrupts, does nothing during a dump
+/// @param id the event identifier
+/// @param a first argument, see trace_id_t
+/// @param b second argument
+/// @param c third argument
+void trace_event(trace_id_t id, uint8_t a, uint16_t b, uint32_t c);
+
+#define TRACE(id, a, b, c) trace_event(id, a, b, c)
+#else
+#define TRACE(id, a, b, c)
+#endif
+
+/// @brief Feed one byte received from the host to the dump parser
+/// A dump command writes the thread names and the stream size, the records
+/// follow from trace_poll()
+/// @param byte the received byte
+/// @return true if the byte is a dump command, false otherwise
+bool trace_feed(uint8_t byte);
+
+/// @brief Write the next records of a dump in progress
+/// Call it once per block, it never waits for the TX buffer to drain
+void trace_poll();
+
+#endif // TRACE_H
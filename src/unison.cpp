@@ -0,0 +1,33 @@
+#include "dsp.h"
+
+#include "unison.hpp"
+
+#include <math.h>
+
+void unison_update(unison_t &unison) {
+  int n = unison.voices;
+  float gains[UNISON_MAX_VOICES];
+  float power = 0.;
+
+  for (int i = 0; i < n; i++) {
+    // Copies are spread symmetrically around the undetuned frequency,
+    // offset from -1 (lowest) to 1 (highest)
+    float offset = n > 1 ? (2.f * i - (n - 1)) / (n - 1) : 0.f;
+    unison.ratio[i] = powf(2.f, unison.detune * offset / 1200.f);
+
+    // The two center copies play at full level, the others at the mix level
+    bool center = (i == n / 2) || (i == (n - 1) / 2);
+    gains[i] = center ? 1.f : unison.mix;
+    power += gains[i] * gains[i];
+  }
+
+  // Detuned copies sum incoherently, normalize the power so the level does
+  // not depend on the number of copies
+  float norm = power > 0.f ? 16384.f / sqrtf(power) : 0.f;
+
+  for (int i = 0; i < n / 2; i++) {
+    uint32_t lo = (uint16_t)(int16_t)(gains[2 * i] * norm);
+    uint32_t hi = (uint16_t)(int16_t)(gains[2 * i + 1] * norm);
+    unison.gain[i] = lo | (hi << 16);
+  }
+}
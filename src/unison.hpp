@@ -0,0 +1,124 @@
+#ifndef UNISON_H
+#define UNISON_H
+
+#include <stdint.h>
+
+#if defined(__ARM_FEATURE_DSP)
+#include <arm_math.h>
+#endif
+
+/// @brief Maximum number of detuned copies per oscillator
+const int UNISON_MAX_VOICES = 8;
+/// @brief Gains are packed two 16-bit lanes per 32-bit word
+const int UNISON_WORDS = UNISON_MAX_VOICES / 2;
+
+/// @brief Maximum detune of the outermost copies, in cents
+const float UNISON_MAX_DETUNE = 50.;
+
+/// @brief Unison parameters shared by all voices
+typedef struct unison {
+  uint8_t voices; // 1 (off), 2, 4, 6 or 8 copies
+  float detune;   // detune of the outermost copies, in cents
+  float mix;      // level of the side copies relative to the center ones
+  float ratio[UNISON_MAX_VOICES];      // frequency ratio of every copy
+  uint32_t gain[UNISON_WORDS];         // packed Q14 gain of every copy
+  int voices_enc;
+  int detune_enc;
+  int mix_enc;
+} unison_t;
+
+/// @brief Recompute the per-copy ratios and gains after a parameter change
+/// @param unison the unison parameters
+void unison_update(unison_t &unison);
+
+/*
+ * Packed 16-bit lane arithmetic. On the Cortex-M4 these are single DSP
+ * instructions, the fallback keeps the unison engine usable on other targets.
+ */
+#if defined(__ARM_FEATURE_DSP)
+/// @brief Pack the top halves of two words, a in the low lane
+static inline uint32_t lanes_pack_top(uint32_t a, uint32_t b) {
+  return __PKHTB(b, a, 16);
+}
+
+/// @brief Signed dual multiply-accumulate of both lanes
+static inline int32_t lanes_mac(uint32_t a, uint32_t b, int32_t acc) {
+  return __SMLAD(a, b, acc);
+}
+#else
+static inline uint32_t lanes_pack_top(uint32_t a, uint32_t b) {
+  return (a >> 16) | (b & 0xFFFF0000);
+}
+
+static inline int32_t lanes_mac(uint32_t a, uint32_t b, int32_t acc) {
+  return acc + (int16_t)a * (int16_t)b +
+         (int16_t)(a >> 16) * (int16_t)(b >> 16);
+}
+#endif
+
+/// @brief Detuned phase accumulators of one oscillator of one key
+/// The phases are 16.16 like the oscillators', a 16-bit increment would be
+/// tens of cents flat in the bass and merge close detune ratios
+class Unison {
+public:
+  uint32_t _phase[UNISON_MAX_VOICES];
+  uint32_t _increment[UNISON_MAX_VOICES];
+
+  /// @brief Default constructor
+  /// The copies start spread over the cycle so they do not begin in phase
+  Unison() {
+    for (int i = 0; i < UNISON_WORDS; i++) {
+      _phase[2 * i] = (i * 0x9E37u) << 16;
+      _phase[2 * i + 1] = (i * 0x9E37u + 0x4F1Bu) << 16;
+      _increment[2 * i] = 0;
+      _increment[2 * i + 1] = 0;
+    }
+  }
+
+  /// @brief Set the phase increments of all copies, at control rate
+  /// @param increment the 16.16 phase increment of the undetuned oscillator
+  /// @param unison the unison parameters
+  void set_increment(uint32_t increment, const unison_t &unison) {
+    for (int i = 0; i < unison.voices; i++) {
+      _increment[i] = (uint32_t)((float)increment * unison.ratio[i]);
+    }
+  }
+
+  /// @brief Advance all copies and return their weighted sawtooth sum
+  /// Two copies per multiply: the top halves of their phases are packed, sign
+  /// flipped and dual multiply-accumulated
+  /// @param unison the unison parameters
+  /// @return the next sample, same range as a single oscillator
+  int render_saw(const unison_t &unison) {
+    int32_t acc = 0;
+
+    for (int i = 0; i < unison.voices / 2; i++) {
+      _phase[2 * i] += _increment[2 * i];
+      _phase[2 * i + 1] += _increment[2 * i + 1];
+      uint32_t phases = lanes_pack_top(_phase[2 * i], _phase[2 * i + 1]);
+      // phase - 0x8000 per lane is the phase with its top bit flipped
+      acc = lanes_mac(phases ^ 0x80008000, unison.gain[i], acc);
+    }
+
+    return acc >> 14;
+  }
+
+  /// @brief Advance all copies and return the weighted sum of any waveform
+  /// @param unison the unison parameters
+  /// @param wave callable returning the oscillator sample for a phase
+  /// @return the next sample, same range as a single oscillator
+  template <typename Wave> int render(const unison_t &unison, Wave wave) {
+    int32_t acc = 0;
+
+    for (int i = 0; i < unison.voices / 2; i++) {
+      _phase[2 * i] += _increment[2 * i];
+      _phase[2 * i + 1] += _increment[2 * i + 1];
+      acc += wave(_phase[2 * i] >> 16) * (int16_t)unison.gain[i];
+      acc += wave(_phase[2 * i + 1] >> 16) * (int16_t)(unison.gain[i] >> 16);
+    }
+
+    return acc >> 14;
+  }
+};
+
+#endif // UNISON_H
@@ -1,3 +1,4 @@
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -19,10 +20,37 @@ LOG_MODULE_REGISTER(cdc_acm_echo, LOG_LEVEL_INF);
 uint8_t ring_buffer_rx[RING_BUF_SIZE];
 struct ring_buf ringbuf_rx;
 
-#define RING_BUF_SIZE 1024
-uint8_t ring_buffer_tx[RING_BUF_SIZE];
+// TX buffer size, a few seconds of reports. Can be set at build time, e.g.
+// -DEXTRA_CFLAGS=-DUSB_TX_BUF_SIZE=8192, for high rate telemetry
+#ifndef USB_TX_BUF_SIZE
+#define USB_TX_BUF_SIZE 2048
+#endif
+uint8_t ring_buffer_tx[USB_TX_BUF_SIZE];
 struct ring_buf ringbuf_tx;
 
+// Serializes the writers, the interrupt handler is the only reader
+static struct k_spinlock tx_lock;
+
+// Messages that did not fit in the TX buffer, and their bytes. When they keep
+// counting up with the host connected, raise USB_TX_BUF_SIZE
+static uint32_t tx_dropped_messages = 0;
+static uint32_t tx_dropped_bytes = 0;
+// Set while the TX interrupt is enabled, cleared by the interrupt handler
+// once the buffer is empty. Both under tx_lock
+static bool tx_busy = false;
+// DTR as of the last usbPoll()
+static volatile bool host_open = false;
+// Reserved to a binary stream, see usbReserve()
+static volatile bool tx_reserved = false;
+// Dropped messages already reported by usbPoll()
+static uint32_t tx_reported_messages = 0;
+
+// Received bytes that did not fit in the RX buffer, and those reported
+static uint32_t rx_dropped_bytes = 0;
+static uint32_t rx_reported_bytes = 0;
+
+int printuln(const char *format, ...);
+
 static void interrupt_handler(const struct device *dev, void *user_data) {
   ARG_UNUSED(user_data);
 
@@ -30,44 +58,54 @@ static void interrupt_handler(const struct device *dev, void *user_data) {
     if (uart_irq_rx_ready(dev)) {
       int recv_len, rb_len;
       uint8_t buffer[64];
-      size_t len = MIN(ring_buf_space_get(&ringbuf_rx), sizeof(buffer));
 
-      recv_len = uart_fifo_read(dev, buffer, len);
+      // The FIFO is always emptied, or the interrupt would stay pending:
+      // what does not fit in a full buffer is dropped and counted
+      recv_len = uart_fifo_read(dev, buffer, sizeof(buffer));
       if (recv_len < 0) {
-        printk("Failed to read UART FIFO");
         recv_len = 0;
-      };
+      }
 
       rb_len = ring_buf_put(&ringbuf_rx, buffer, recv_len);
-      if (rb_len < recv_len) {
-        printk("Drop %u bytes", recv_len - rb_len);
-      }
+      rx_dropped_bytes += recv_len - rb_len;
     }
 
     if (uart_irq_tx_ready(dev)) {
-      uint8_t buffer[64];
-      int rb_len, send_len;
-
-      rb_len = ring_buf_get(&ringbuf_tx, buffer, sizeof(buffer));
-      if (!rb_len) {
-        printk("Ring buffer empty, disable TX IRQ");
+      // Checked with the writers locked out, so that a write never finds
+      // the interrupt busy while it is being disabled
+      k_spinlock_key_t key = k_spin_lock(&tx_lock);
+      uint8_t *data;
+      uint32_t len = ring_buf_get_claim(&ringbuf_tx, &data, USB_TX_BUF_SIZE);
+      if (!len) {
         uart_irq_tx_disable(dev);
+        tx_busy = false;
+        k_spin_unlock(&tx_lock, key);
         continue;
       }
+      k_spin_unlock(&tx_lock, key);
 
-      send_len = uart_fifo_fill(dev, buffer, rb_len);
-      if (send_len < rb_len) {
-        printk("Drop %d bytes", rb_len - send_len);
-      }
+      // Sent straight from the buffer, what the FIFO refused is sent next
+      int send_len = uart_fifo_fill(dev, data, len);
+      ring_buf_get_finish(&ringbuf_tx, send_len > 0 ? send_len : 0);
     }
   }
 }
 
 const struct device *dev;
 
+// Set once the CDC ACM device is enabled, the port stays unused otherwise
+static bool usb_ready = false;
+
+// Serializes the print functions, which share the formatting buffer
+K_MUTEX_DEFINE(print_mutex);
+
 int initUsb() {
   int ret;
 
+  // Output is buffered even if USB is not available
+  ring_buf_init(&ringbuf_tx, sizeof(ring_buffer_tx), ring_buffer_tx);
+  ring_buf_init(&ringbuf_rx, sizeof(ring_buffer_rx), ring_buffer_rx);
+
   dev = DEVICE_DT_GET_ONE(zephyr_cdc_acm_uart);
   if (!device_is_ready(dev)) {
     printk("CDC ACM device not ready");
@@ -81,22 +119,64 @@ int initUsb() {
     return -1;
   }
 
-  ring_buf_init(&ringbuf_tx, sizeof(ring_buffer_tx), ring_buffer_tx);
-  ring_buf_init(&ringbuf_rx, sizeof(ring_buffer_rx), ring_buffer_rx);
-
   uart_irq_callback_set(dev, interrupt_handler);
 
   /* Enable rx interrupts */
   uart_irq_rx_enable(dev);
 
+  usb_ready = true;
   return 0;
 }
 
+int usbConnected() { return host_open; }
+
+/// @brief Enable the TX interrupt on the idle to busy transition
+/// Only when a host is there and something is buffered. The handler sends
+/// the buffer until it is empty, the writes meanwhile only fill it
+static void tx_start() {
+  k_spinlock_key_t key = k_spin_lock(&tx_lock);
+  bool start = !tx_busy && host_open && !ring_buf_is_empty(&ringbuf_tx);
+  if (start) {
+    tx_busy = true;
+  }
+  k_spin_unlock(&tx_lock, key);
+
+  if (start) {
+    uart_irq_tx_enable(dev);
+  }
+}
+
+void usbPoll() {
+  // The DTR line is queried once per poll instead of on every write
+  if (usb_ready) {
+    uint32_t dtr = 0U;
+    uart_line_ctrl_get(dev, UART_LINE_CTRL_DTR, &dtr);
+    host_open = dtr != 0U;
+  }
+
+  uint32_t dropped = tx_dropped_messages;
+  if (dropped != tx_reported_messages &&
+      printuln("[USB] %u messages dropped, %u bytes", dropped,
+               tx_dropped_bytes) > 0) {
+    tx_reported_messages = dropped;
+  }
+
+  uint32_t rx_dropped = rx_dropped_bytes;
+  if (rx_dropped != rx_reported_bytes &&
+      printuln("[USB] %u received bytes dropped", rx_dropped) > 0) {
+    rx_reported_bytes = rx_dropped;
+  }
+
+  // Flush what was printed before the host opened the port
+  tx_start();
+}
+
 void waitForUsb() {
   while (true) {
     uint32_t dtr = 0U;
     uart_line_ctrl_get(dev, UART_LINE_CTRL_DTR, &dtr);
     if (dtr) {
+      host_open = true;
       break;
     } else {
       /* Give CPU resources to low priority threads. */
@@ -115,23 +195,80 @@ int usbRead(char *data, uint32_t size) {
 
 /// @return Amount of bytes written to uart.
 int usbWrite(const uint8_t *data, uint32_t size) {
-  int res = ring_buf_put(&ringbuf_tx, data, size);
-  uart_irq_tx_enable(dev);
-  return res;
+  // Never blocks: without a host the data stays buffered. A message is
+  // enqueued whole or dropped whole, so that a full buffer never cuts a line
+  k_spinlock_key_t key = k_spin_lock(&tx_lock);
+  if (ring_buf_space_get(&ringbuf_tx) < size) {
+    tx_dropped_messages++;
+    tx_dropped_bytes += size;
+    k_spin_unlock(&tx_lock, key);
+    return 0;
+  }
+
+  // Two claims when the message wraps around the end of the buffer
+  uint32_t written = 0;
+  while (written < size) {
+    uint8_t *space;
+    uint32_t len = ring_buf_put_claim(&ringbuf_tx, &space, size - written);
+    memcpy(space, data + written, len);
+    ring_buf_put_finish(&ringbuf_tx, len);
+    written += len;
+  }
+  k_spin_unlock(&tx_lock, key);
+
+  tx_start();
+  return size;
 }
 
 int usbRxBufferLen() { return ring_buf_size_get(&ringbuf_rx); }
 
 int usbTxBufferLen() { return ring_buf_size_get(&ringbuf_tx); }
 
-char buffer[256];
+int usbTxSpace() { return ring_buf_space_get(&ringbuf_tx); }
+
+uint32_t usbTxDropped() { return tx_dropped_messages; }
+
+void usbReserve(int reserved) { tx_reserved = reserved != 0; }
+
+/// @brief Take the print buffer, or drop and count the message
+/// Never waits: a message printed while another thread formats one, or while
+/// the port is reserved, is dropped
+/// @return true if the buffer is taken, print_mutex is then locked
+static bool print_lock() {
+  if (!tx_reserved && k_mutex_lock(&print_mutex, K_NO_WAIT) == 0) {
+    return true;
+  }
+
+  k_spinlock_key_t key = k_spin_lock(&tx_lock);
+  tx_dropped_messages++;
+  k_spin_unlock(&tx_lock, key);
+  return false;
+}
+
+#define PRINT_BUF_SIZE 256
+char buffer[PRINT_BUF_SIZE];
+
+/// @brief Format into the shared buffer, leaving room for the line end
+/// @return the number of formatted bytes, truncated to the buffer
+static int format_message(const char *format, va_list args) {
+  int count = vsnprintf(buffer, PRINT_BUF_SIZE - 2, format, args);
+  if (count < 0) {
+    return 0;
+  }
+  return MIN(count, PRINT_BUF_SIZE - 3);
+}
 
 int printu(const char *format, ...) {
+  if (!print_lock()) {
+    return 0;
+  }
+
   va_list args;
   va_start(args, format);
 
-  int count = vsnprintf(&buffer, 256, format, args);
-  int res = usbWrite(&buffer, count);
+  int count = format_message(format, args);
+  int res = usbWrite((const uint8_t *)buffer, count);
+  k_mutex_unlock(&print_mutex);
 
   va_end(args);
 
@@ -139,12 +276,19 @@ int printu(const char *format, ...) {
 }
 
 int printuln(const char *format, ...) {
+  if (!print_lock()) {
+    return 0;
+  }
+
   va_list args;
   va_start(args, format);
 
-  int count = vsnprintf(&buffer, 256, format, args);
-  int res = usbWrite(&buffer, count);
-  res += usbWrite("\r\n", 2);
+  // One write per line, a line is never interleaved nor cut
+  int count = format_message(format, args);
+  buffer[count++] = '\r';
+  buffer[count++] = '\n';
+  int res = usbWrite((const uint8_t *)buffer, count);
+  k_mutex_unlock(&print_mutex);
 
   va_end(args);
 
@@ -12,6 +12,15 @@ int initUsb();
 /// open
 void waitForUsb();
 
+/// @brief Check whether a host has opened the port
+/// The DTR line is read by usbPoll(), the state is that of the last poll
+/// @return 1 if the port is open, 0 otherwise
+int usbConnected();
+
+/// @brief Start sending the buffered output once a host opens the port
+/// Call this function periodically, printing never waits for the host
+void usbPoll();
+
 /// @brief Returns receiver buffer length
 /// @return receiver buffer length
 int usbRxBufferLen();
@@ -26,21 +35,43 @@ int usbRead(char *data, uint32_t size);
 /// @return transmitter buffer length
 int usbTxBufferLen();
 
+/// @brief Free space in the transmitter buffer
+/// Producers of high rate output can check it to skip a message instead of
+/// having it dropped
+/// @return free bytes in the transmitter buffer
+int usbTxSpace();
+
+/// @brief Number of messages dropped because the transmitter buffer was full
+/// usbPoll() also prints the count when it changes
+/// @return dropped messages since boot
+uint32_t usbTxDropped();
+
+/// @brief Reserve the port to the data written with usbWrite()
+/// While reserved, the lines of printu() and printuln() are dropped and
+/// counted, so that they do not land in the middle of a binary stream
+/// @param reserved 1 to reserve the port, 0 to release it
+void usbReserve(int reserved);
+
 /// @brief Write data to the USB port
+/// Never blocks. The data is buffered whole, or dropped whole and counted
+/// when the transmitter buffer cannot hold it
 /// @param data data pointer
 /// @param size number of bytes to write
-/// @return number of bytes written
+/// @return size if the data was buffered, 0 if it was dropped
 int usbWrite(const uint8_t *data, uint32_t size);
 
 /// @brief basic print function
-/// Does not support floating point, does not print a new line
+/// Does not support floating point, does not print a new line. Never waits:
+/// while another thread prints, the message is dropped and counted
 /// @param format C standard string format
 /// @param variables to parse into the string
 /// @return Number of bytes written
 int printu(const char *format, ...);
 
 /// @brief basic println function
-/// Does not support floating point, does print a new line
+/// Does not support floating point, does print a new line. The line is
+/// written at once, truncated to 253 characters. Never waits: while another
+/// thread prints, the line is dropped and counted
 /// @param format C standard string format
 /// @param variables to parse into the string
 /// @return Number of bytes written
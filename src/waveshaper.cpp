@@ -0,0 +1,136 @@
+#include "dsp.h"
+
+#include "waveshaper.hpp"
+
+#include <math.h>
+#include <string.h>
+
+#include "effect.hpp"
+#include "memmap.h"
+
+DSP_STATE int16_t SHAPER_LUT[SHAPER_LUT_SIZE + 1];
+
+// Halfband lowpass, 31 taps, Kaiser window (beta 7): -0.3 dB at 0.2 and
+// -30 dB from 0.3 of the oversampled rate, padded with a 0 to 32 taps.
+// Every other tap is 0, the interpolator's coefficients have a gain of 2
+DSP_TABLE const q15_t HALFBAND_UP[SHAPER_TAPS] = {
+    -8, 0, 70, 0, -247, 0, 643, 0,
+    -1415, 0, 2883, 0, -6101, 0, 20561, 32766,
+    20561, 0, -6101, 0, 2883, 0, -1415, 0,
+    643, 0, -247, 0, 70, 0, -8, 0};
+DSP_TABLE const q15_t HALFBAND_DOWN[SHAPER_TAPS] = {
+    -4, 0, 35, 0, -124, 0, 321, 0,
+    -708, 0, 1441, 0, -3050, 0, 10281, 16383,
+    10281, 0, -3050, 0, 1441, 0, -708, 0,
+    321, 0, -124, 0, 35, 0, -4, 0};
+
+void shaper_init() {
+  for (int i = 0; i <= SHAPER_LUT_SIZE; i++) {
+    float x = SHAPER_LUT_RANGE * (2.f * i / SHAPER_LUT_SIZE - 1.f);
+    SHAPER_LUT[i] = (int16_t)(tanhf(x) * 32767.f);
+  }
+}
+
+void shaper_update(shaper_t &shaper) {
+  // 0 dB to 36 dB, 6 dB every 5 steps
+  if (shaper.drive_enc == 0) {
+    shaper.drive = 0;
+  } else {
+    shaper.drive = (int16_t)(256.f * exp2f((shaper.drive_enc - 1) / 5.f));
+  }
+
+  shaper.level = enc_level(shaper.level_enc);
+  shaper.factor = 1 << shaper.factor_enc;
+}
+
+void Waveshaper::configure(uint8_t factor) {
+  memset(_up_state, 0, sizeof(_up_state));
+  memset(_down_state, 0, sizeof(_down_state));
+
+  // Stage 0 runs at 1x to 2x, stage 1 at 2x to 4x
+  for (int stage = 0; stage < 2; stage++) {
+    arm_fir_interpolate_init_q15(&_up[stage], 2, SHAPER_TAPS, HALFBAND_UP,
+                                 _up_state[stage],
+                                 (stage + 1) * SHAPER_CHUNK);
+    arm_fir_decimate_init_q15(&_down[stage], SHAPER_TAPS, 2, HALFBAND_DOWN,
+                              _down_state[stage],
+                              2 * (stage + 1) * SHAPER_CHUNK);
+  }
+
+  _factor = factor;
+}
+
+DSP_CODE void Waveshaper::shape(q15_t *x, int n, const shaper_t &params,
+                                gain_ramp_t *ramp) {
+  int32_t drive = params.drive;
+  int32_t level = params.level;
+  const int32_t range = SHAPER_LUT_RANGE * 32768;
+  const int shift = 9; // 2 * range / SHAPER_LUT_SIZE = 2^9 per entry
+
+  for (int i = 0; i < n; i++) {
+    int32_t in = (x[i] * drive) >> 8;
+    if (in >= range) {
+      in = range - 1;
+    } else if (in < -range) {
+      in = -range;
+    }
+
+    // Linear interpolation between two LUT entries
+    uint32_t pos = in + range;
+    int index = pos >> shift;
+    int32_t frac = pos & ((1 << shift) - 1);
+    int32_t a = SHAPER_LUT[index];
+    int32_t y = a + (((SHAPER_LUT[index + 1] - a) * frac) >> shift);
+
+    x[i] = ramp_sample(ramp, (y * level) >> 15);
+  }
+}
+
+DSP_CODE void Waveshaper::process(int16_t *block, int n,
+                                  const shaper_t &params, gain_ramp_t *ramp) {
+  if (params.drive == 0) {
+    _factor = 0;
+    return;
+  }
+
+  // Filter states of another factor would replay old samples
+  if (params.factor != _factor) {
+    configure(params.factor);
+  }
+
+  // The gain ramps in the shaping at the oversampled rate, ahead of the
+  // decimators: they are linear and the ramp is far below their cutoff
+  gain_ramp_t fast = {0, 0};
+  gain_ramp_t *shaped = nullptr;
+  if (ramp != nullptr) {
+    fast = {ramp->gain, ramp->step / _factor};
+    shaped = &fast;
+  }
+
+  for (int base = 0; base < n; base += SHAPER_CHUNK) {
+    int count = n - base < SHAPER_CHUNK ? n - base : SHAPER_CHUNK;
+    q15_t *x = &block[base];
+
+    switch (_factor) {
+    case 2:
+      arm_fir_interpolate_q15(&_up[0], x, _x2, count);
+      shape(_x2, 2 * count, params, shaped);
+      arm_fir_decimate_q15(&_down[0], _x2, x, 2 * count);
+      break;
+    case 4:
+      arm_fir_interpolate_q15(&_up[0], x, _x2, count);
+      arm_fir_interpolate_q15(&_up[1], _x2, _x4, 2 * count);
+      shape(_x4, 4 * count, params, shaped);
+      arm_fir_decimate_q15(&_down[1], _x4, _x2, 4 * count);
+      arm_fir_decimate_q15(&_down[0], _x2, x, 2 * count);
+      break;
+    default:
+      shape(x, count, params, shaped);
+      break;
+    }
+  }
+
+  if (ramp != nullptr) {
+    ramp->gain = fast.gain;
+  }
+}
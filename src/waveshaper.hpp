@@ -0,0 +1,83 @@
+#ifndef WAVESHAPER_H
+#define WAVESHAPER_H
+
+#include "effect.hpp"
+#include <arm_math.h>
+#include <stdint.h>
+
+/// @brief Largest oversampling factor, two cascaded 2x stages
+const int SHAPER_MAX_FACTOR = 4;
+
+/// @brief Input samples resampled per pass, bounds the work buffers
+const int SHAPER_CHUNK = 64;
+
+/// @brief Taps of the halfband filters, a multiple of the interpolation
+/// factor of a stage
+const int SHAPER_TAPS = 32;
+
+/// @brief Entries of the curve LUT, plus one for the interpolation
+const int SHAPER_LUT_SIZE = 512;
+
+/// @brief Input range of the curve LUT, in full scales
+const int SHAPER_LUT_RANGE = 4;
+
+/// @brief Distortion curve, tanh over +/-SHAPER_LUT_RANGE, Q15
+extern int16_t SHAPER_LUT[SHAPER_LUT_SIZE + 1];
+
+/// @brief Distortion parameters
+typedef struct shaper {
+  int16_t drive;  // input gain, Q8, 0 = off
+  int16_t level;  // output gain, Q15
+  uint8_t factor; // oversampling factor, 1, 2 or 4
+  int drive_enc;
+  int level_enc;
+  int factor_enc;
+} shaper_t;
+
+/// @brief Fill the curve LUT
+/// Call this function once during initialization
+void shaper_init();
+
+/// @brief Recompute the gains and the factor after a parameter change
+/// @param shaper the distortion parameters
+void shaper_update(shaper_t &shaper);
+
+/// @brief Oversampled waveshaper, processed in place one block at a time
+/// The block is upsampled by the CMSIS polyphase interpolators, shaped by the
+/// curve LUT and decimated back, so the harmonics of the curve above the
+/// original Nyquist frequency are filtered instead of aliased
+class Waveshaper {
+public:
+  arm_fir_interpolate_instance_q15 _up[2];
+  arm_fir_decimate_instance_q15 _down[2];
+  q15_t _up_state[2][SHAPER_TAPS / 2 + 2 * SHAPER_CHUNK - 1];
+  q15_t _down_state[2][SHAPER_TAPS + 4 * SHAPER_CHUNK - 1];
+  q15_t _x2[2 * SHAPER_CHUNK]; // 2x oversampled chunk
+  q15_t _x4[4 * SHAPER_CHUNK]; // 4x oversampled chunk
+  uint8_t _factor;             // factor the filters are set up for, 0 = none
+
+  /// @brief Default constructor, the filters are set up on first use
+  Waveshaper() : _factor{0} {}
+
+  /// @brief Distort a block
+  /// @param block the audio samples, modified in place
+  /// @param n number of samples
+  /// @param params the distortion parameters
+  /// @param ramp the master gain ramp if this is the last active stage
+  void process(int16_t *block, int n, const shaper_t &params,
+               gain_ramp_t *ramp = nullptr);
+
+private:
+  /// @brief Set the filters up for an oversampling factor, with empty states
+  /// @param factor the oversampling factor
+  void configure(uint8_t factor);
+
+  /// @brief Apply the drive, the curve and the output level in place
+  /// @param x the samples
+  /// @param n number of samples
+  /// @param params the distortion parameters
+  /// @param ramp the master gain ramp, stepped at the rate of x, or nullptr
+  void shape(q15_t *x, int n, const shaper_t &params, gain_ramp_t *ramp);
+};
+
+#endif // WAVESHAPER_H
@@ -0,0 +1,134 @@
+#include "dsp.h"
+
+#include "wavetable.hpp"
+
+#include <string.h>
+#include <zephyr/kernel.h>
+
+#include "sine.hpp"
+#include "usb.h"
+
+WavetableBank wt_bank;
+
+static int16_t clamp_sample(int sample) {
+  if (sample > 0x7fff)
+    return 0x7fff;
+  else if (sample < -0x7fff)
+    return -0x7fff;
+  return sample;
+}
+
+void WavetableBank::initialize() {
+  // Same shapes as the fixed oscillator waves, so the default bank morphs
+  // sine -> triangle -> square -> sawtooth
+  for (int i = 0; i < WT_FRAME_SIZE; i++) {
+    int phase = i << 8;
+
+    _frames[0][i] = (int)SINE_LUT[phase >> 6] - 0x8000;
+    _frames[1][i] = clamp_sample(phase <= 0x8000 ? 2 * (phase - 0x4000)
+                                                 : -2 * (phase - 0xC000));
+    _frames[2][i] = phase <= 0x8000 ? -0x7fff : 0x7fff;
+    _frames[3][i] = phase - 0x8000;
+  }
+
+  _count = 4;
+  _version++;
+}
+
+void WavetableBank::morph(int16_t *dst, uint16_t position) const {
+  int last = (_count - 1) * WT_POSITION_PER_FRAME;
+  if (position > last) {
+    position = last;
+  }
+
+  int frame = position / WT_POSITION_PER_FRAME;
+  int frac = position % WT_POSITION_PER_FRAME;
+  const int16_t *a = _frames[frame];
+
+  if (frac == 0) {
+    memcpy(dst, a, WT_FRAME_SIZE * sizeof(int16_t));
+  } else {
+    const int16_t *b = _frames[frame + 1];
+    for (int i = 0; i < WT_FRAME_SIZE; i++) {
+      dst[i] = a[i] + (((b[i] - a[i]) * frac) >> 8);
+    }
+  }
+
+  // Guard sample so the interpolated read never needs to wrap the index
+  dst[WT_FRAME_SIZE] = dst[0];
+}
+
+bool WavetableBank::feed(uint8_t byte) {
+  // The rest of a frame cut short never comes, the byte starts over
+  int64_t now = k_uptime_get();
+  if (_state != WT_IDLE && now - _last_byte > WT_BYTE_TIMEOUT_MS) {
+    printuln("[Wavetable] Incomplete frame discarded");
+    _state = WT_IDLE;
+  }
+  _last_byte = now;
+
+  switch (_state) {
+  case WT_IDLE:
+    if (byte != WT_UPLOAD_START) {
+      return false;
+    }
+    _state = WT_COUNT;
+    break;
+  case WT_COUNT:
+    _upload_count = byte;
+    _state = WT_INDEX;
+    break;
+  case WT_INDEX:
+    _upload_index = byte;
+    _upload_pos = 0;
+    _upload_sum = 0;
+    _state = WT_DATA;
+    break;
+  case WT_DATA:
+    _staging[_upload_pos++] = byte;
+    _upload_sum += byte;
+    if (_upload_pos == sizeof(_staging)) {
+      _state = WT_CHECKSUM;
+    }
+    break;
+  case WT_CHECKSUM:
+    _state = WT_IDLE;
+
+    if (byte != _upload_sum) {
+      printuln("[Wavetable] Frame %d dropped: bad checksum", _upload_index);
+      break;
+    }
+    if (_upload_count == 0 || _upload_count > WT_MAX_FRAMES ||
+        _upload_index >= _upload_count) {
+      printuln("[Wavetable] Frame %d/%d dropped: out of range", _upload_index,
+               _upload_count);
+      break;
+    }
+
+    // A new upload starts with its first frame or another frame count
+    if (_upload_index == 0 || _upload_count != _upload_total) {
+      _upload_total = _upload_count;
+      _upload_received = 0;
+    }
+
+    // Frames are only replaced between blocks, so the renderer never sees a
+    // partially written frame
+    for (int i = 0; i < WT_FRAME_SIZE; i++) {
+      _frames[_upload_index][i] =
+          (int16_t)(_staging[2 * i] | (_staging[2 * i + 1] << 8));
+    }
+    _upload_received |= 1 << _upload_index;
+    printuln("[Wavetable] Frame %d/%d uploaded", _upload_index, _upload_count);
+
+    // The bank takes the new count once every frame passed its checksum
+    if (_upload_received == (1 << _upload_total) - 1) {
+      _count = _upload_total;
+      _upload_received = 0;
+      _version++;
+      printuln("[Wavetable] Bank of %d frames loaded", _count);
+    }
+    break;
+  }
+
+  return true;
+}
@@ -0,0 +1,92 @@
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <stdint.h>
+
+/// @brief Number of samples in a single-cycle frame, indexed by phase >> 8
+const int WT_FRAME_SIZE = 256;
+/// @brief Maximum number of frames in the bank
+const uint8_t WT_MAX_FRAMES = 16;
+/// @brief Morph position units per frame, position = frame << 8 | fraction
+const int WT_POSITION_PER_FRAME = 256;
+
+/**
+ * Upload protocol, over the CDC port:
+ *   0x01 (SOH), frame count, frame index,
+ *   WT_FRAME_SIZE samples as little-endian int16,
+ *   checksum (8-bit sum of the sample bytes)
+ * The frame is staged and only copied into the bank once complete and valid.
+ *
+ * Flow control: every frame is answered by one line, "[Wavetable] Frame i/n
+ * uploaded" or "[Wavetable] Frame i/n dropped: ...". The host waits for it
+ * before sending the next frame, and resends the frame when it is dropped or
+ * unanswered after WT_ACK_TIMEOUT_MS. A single frame is then in flight, which
+ * fits the RX buffer drained once per block.
+ *
+ * A frame cut short, e.g. by bytes dropped on a full RX buffer, is discarded
+ * when no byte follows within WT_BYTE_TIMEOUT_MS, so that the resent frame
+ * is parsed from its start.
+ *
+ * The bank only grows to the upload's frame count once all its frames have
+ * arrived, the oscillators never morph towards a frame not uploaded yet.
+ */
+const uint8_t WT_UPLOAD_START = 0x01;
+/// @brief Time after which the host resends an unanswered frame
+const int WT_ACK_TIMEOUT_MS = 200;
+/// @brief Longest gap between two bytes of a frame, above the 50 ms the RX
+/// buffer can wait to be drained and below WT_ACK_TIMEOUT_MS
+const int WT_BYTE_TIMEOUT_MS = 100;
+
+/// @brief Bank of user-uploadable single-cycle frames
+class WavetableBank {
+public:
+  int16_t _frames[WT_MAX_FRAMES][WT_FRAME_SIZE];
+  uint8_t _count;
+  // Incremented when the bank content changes, oscillators re-morph then
+  uint32_t _version;
+
+  /// @brief Default constructor, the bank is empty until initialized
+  WavetableBank()
+      : _count{0}, _version{0}, _state{WT_IDLE}, _upload_total{0},
+        _upload_received{0}, _last_byte{0} {}
+
+  /// @brief Fill the bank with the sine, triangle, square and saw shapes
+  void initialize();
+
+  /// @brief Render the morph between two adjacent frames
+  /// @param dst destination, WT_FRAME_SIZE + 1 samples (wrap guard included)
+  /// @param position morph position, clamped to the last frame
+  void morph(int16_t *dst, uint16_t position) const;
+
+  /// @brief Feed one byte received from the host to the upload parser
+  /// @param byte the received byte
+  /// @return true if the byte belongs to an upload, false otherwise
+  bool feed(uint8_t byte);
+
+  /// @brief Check whether an upload is in progress
+  /// @return true if the parser is in the middle of a frame
+  bool uploading() const { return _state != WT_IDLE; }
+
+private:
+  typedef enum {
+    WT_IDLE,
+    WT_COUNT,
+    WT_INDEX,
+    WT_DATA,
+    WT_CHECKSUM
+  } upload_state_t;
+
+  upload_state_t _state;
+  uint8_t _upload_count;
+  uint8_t _upload_index;
+  uint16_t _upload_pos;
+  uint8_t _upload_sum;
+  uint8_t _upload_total;     // frame count of the upload being received
+  uint16_t _upload_received; // frames of that upload received, one bit each
+  int64_t _last_byte;        // uptime of the last byte fed, in ms
+  uint8_t _staging[WT_FRAME_SIZE * 2];
+};
+
+extern WavetableBank wt_bank;
+
+#endif // WAVETABLE_H
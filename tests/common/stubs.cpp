@@ -0,0 +1,43 @@
+// The hardware facing parts of the application, which the synthesizer core
+// only reaches through these symbols
+
+#include <stdarg.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include "audio.h"
+#include "bench.h"
+#include "peripherals.h"
+#include "synth.hpp"
+#include "usb.h"
+
+Synthesizer synth;
+RotaryEncoder encoders[N_ENCODERS];
+ThreePosSwitch switches[N_SWITCHES];
+
+extern "C" {
+int printu(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vprintk(format, args);
+  va_end(args);
+  return 0;
+}
+
+int printuln(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vprintk(format, args);
+  va_end(args);
+  printk("\n");
+  return 0;
+}
+
+int usbWrite(const uint8_t *data, uint32_t size) { return size; }
+
+int usbConnected() { return 0; }
+}
+
+int setVolume(uint8_t volume) { return 0; }
+
+uint32_t bench_render_voices(int voices) { return 0; }
@@ -0,0 +1,114 @@
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/ztest.h>
+
+#include "preset.hpp"
+
+/// @brief Run the blocks of a queued save until it is written
+/// The output is muted meanwhile and unmuted by the block after
+static void wait_saved() {
+  for (int i = 0; i < 200 && preset_saving(); i++) {
+    preset_apply();
+    k_msleep(10);
+  }
+  zassert_false(preset_saving(), "save not written");
+  preset_apply();
+  zassert_false(synth._muted, "output still muted");
+}
+
+// Boot parameters, restored before every test
+static Synthesizer defaults;
+
+static void *preset_setup(void) {
+  preset_init();
+
+  // The flash simulator keeps its content between runs
+  settings_delete(PRESET_SUBTREE "/5");
+  settings_delete(PRESET_SUBTREE "/6");
+  return NULL;
+}
+
+static void preset_before(void *fixture) {
+  ARG_UNUSED(fixture);
+  synth = defaults;
+}
+
+ZTEST_SUITE(preset, NULL, preset_setup, preset_before, NULL, NULL);
+
+ZTEST(preset, test_round_trip) {
+  synth._master_volume_enc = 30;
+  synth._osc1.volume_enc = 33;
+  synth._osc1.volume = 33 * 33 * 16;
+  synth._lpf._cutoff_enc = 40;
+  synth._pitch.bend = 0.5f;
+  synth._pitch.bend_enc = 4;
+  synth._delay.time_enc = 20;
+  synth._matrix._depth[0][0] = 5;
+
+  zassert_equal(preset_save(2), 0);
+  wait_saved();
+
+  synth = defaults;
+  synth._pitch.last_increment = 456.f;
+  zassert_equal(preset_load(2), 0);
+
+  // Only applied between two blocks
+  zassert_equal(synth._osc1.volume_enc, defaults._osc1.volume_enc);
+  preset_apply();
+
+  zassert_equal(synth._master_volume_enc, 30);
+  zassert_equal(synth._osc1.volume_enc, 33);
+  zassert_equal(synth._osc1.volume, 33 * 33 * 16);
+  zassert_equal(synth._lpf._cutoff_enc, 40);
+  zassert_equal(synth._pitch.bend, 0.5f);
+  zassert_equal(synth._pitch.bend_enc, 4);
+  zassert_equal(synth._delay.time_enc, 20);
+  zassert_equal(synth._matrix._depth[0][0], 5);
+
+  // The glide start is runtime state, not part of the patch
+  zassert_equal(synth._pitch.last_increment, 456.f);
+}
+
+ZTEST(preset, test_save_busy) {
+  // The work queue runs below the test thread, until it sleeps
+  zassert_equal(preset_save(1), 0);
+  zassert_true(preset_saving());
+  zassert_equal(preset_save(1), -EBUSY);
+  wait_saved();
+  zassert_equal(preset_save(1), 0);
+  wait_saved();
+}
+
+ZTEST(preset, test_save_mutes) {
+  zassert_equal(preset_save(3), 0);
+  zassert_false(synth._muted);
+
+  // The next block fades out, the write starts after it
+  preset_apply();
+  zassert_true(synth._muted);
+  zassert_true(preset_saving());
+  wait_saved();
+}
+
+ZTEST(preset, test_empty_slot) { zassert_equal(preset_load(5), -ENOENT); }
+
+ZTEST(preset, test_invalid_slot) {
+  zassert_equal(preset_save(N_PRESETS), -EINVAL);
+  zassert_equal(preset_load(N_PRESETS), -EINVAL);
+}
+
+ZTEST(preset, test_other_version) {
+  patch_t patch = {};
+  patch.magic = PATCH_MAGIC;
+  patch.version = PATCH_VERSION - 1;
+  patch.size = sizeof(patch_t);
+
+  zassert_equal(
+      settings_save_one(PRESET_SUBTREE "/6", &patch, sizeof(patch)), 0);
+  zassert_equal(preset_load(6), -ENOTSUP);
+
+  // Nothing is applied
+  preset_apply();
+  zassert_equal(synth._osc1.volume_enc, defaults._osc1.volume_enc);
+}
@@ -0,0 +1,13 @@
+#include <zephyr/ztest.h>
+
+#include "regression.h"
+#include "synth.hpp"
+
+ZTEST_SUITE(regression, NULL, NULL, NULL, NULL, NULL);
+
+/// @brief Every scenario matches its golden fingerprint
+/// The failed ones print the row of their new fingerprint
+ZTEST(regression, test_golden) {
+  synth.initialize();
+  zassert_equal(regression_check(), 0, "scenarios differ from their golden");
+}
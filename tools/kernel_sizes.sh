@@ -0,0 +1,19 @@
+#!/bin/sh
+# Code size of the render kernels, to weigh against the cycles saved that the
+# [Bench] kernel lines report at boot. See RENDER_KERNELS in src/synth.hpp
+# Usage: tools/kernel_sizes.sh [build/zephyr/zephyr.elf]
+ELF=${1:-build/zephyr/zephyr.elf}
+
+arm-none-eabi-nm -C -S --radix=d "$ELF" |
+  grep 'Synthesizer::render_' |
+  awk '{
+    size = $2 + 0
+    if ($0 ~ /render_kernel</) {
+      total += size
+      count++
+    }
+    $1 = $2 = $3 = ""
+    sub(/^ +/, "")
+    printf "%6d %s\n", size, $0
+  }
+  END { printf "%6d in %d specialized kernels\n", total, count }'
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Regenerate the golden fingerprints of the render regression check: render
+# every scenario on native_sim with REGRESSION_UPDATE set and replace the
+# GOLDEN table of src/regression.cpp with the printed rows. Review the diff:
+# the change of sound must be intended. See "Regression check" in README.md
+# Usage: tools/update_goldens.sh [build directory]
+set -e
+BUILD=${1:-build/goldens}
+SOURCE=src/regression.cpp
+LOG=$BUILD/goldens.log
+
+west build -p auto -b native_sim -d "$BUILD" tests/regression -- \
+  -DEXTRA_CPPFLAGS=-DREGRESSION_UPDATE=1
+# The test fails while the goldens differ, the rows are printed anyway
+"$BUILD/zephyr/zephyr.exe" >"$LOG" 2>&1 || true
+
+if ! grep -q 'Goldens end' "$LOG"; then
+  echo "No golden rows in $LOG" >&2
+  exit 1
+fi
+
+# The rows replace the table body, under a line recording where they come from
+REV=$(git describe --always --dirty)
+awk -v logfile="$LOG" -v rev="$REV" '
+  /^static const golden_t GOLDEN\[\] = \{$/ {
+    print
+    print "    // native_sim, " rev ", tools/update_goldens.sh"
+    while ((getline line < logfile) > 0) {
+      sub(/\r$/, "", line)
+      if (line ~ /Goldens end/) copy = 0
+      if (copy) print line
+      if (line ~ /Goldens begin/) copy = 1
+    }
+    skip = 1
+    next
+  }
+  skip && /^};$/ { skip = 0 }
+  !skip { print }
+' "$SOURCE" >"$SOURCE.new"
+mv "$SOURCE.new" "$SOURCE"
+echo "Updated $SOURCE from $LOG"